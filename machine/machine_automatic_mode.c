@@ -1,10 +1,20 @@
 #include "pico/stdlib.h"
+#include <math.h>
 #include "machine_controller.h"
 #include "machine_automatic_mode.h"
 #include "machine_manual_mode.h"
 #include "mark_detector.h"
 
 static const float STICKER_HEIGHT_TOLERNACE = 10.0; // 10mm tolerance for sticker height
+
+// Cut speed governor, error is relative to the following error envelope, duty to full PWM
+static const float CUT_SPEED_RAISE = 1.1f;      // Speed factor after a stroke with good tracking
+static const float CUT_SPEED_BACKOFF = 0.8f;    // Speed factor after a stroke with poor tracking or high drag
+static const float CUT_ERROR_GOOD = 0.3f;       // Speed is raised only below this peak error
+static const float CUT_ERROR_POOR = 0.6f;       // Speed backs off above this peak error
+static const float CUT_DUTY_GOOD = 0.6f;        // Speed is raised only below this peak cruise duty
+static const float CUT_DUTY_POOR = 0.8f;        // Speed backs off above this peak cruise duty
+static const float CUT_JOB_TOLERANCE = 5.0f;    // Right mark set again within this distance continues the job
 char state_text_1[21];
 char state_text_2[21];
 
@@ -25,6 +35,14 @@ typedef struct {
     float third_mark_position;            // Position of third detected mark
 
     float last_stop_position;             // Last known position of the cutting head
+
+    // Cut speed learned for the job, tracking of the cutter while the knife is down
+    float cut_speed;                      // Speed of the knife down legs
+    float cut_job_mark;                   // Right paper mark of the job the cut speed was learned for
+    float cut_error_peak;                 // Peak following error of the stroke, relative to the envelope
+    float cut_duty_peak;                  // Peak duty of the stroke at cut speed
+    bool cut_sampled;                     // Stroke reached cut speed with the knife down
+    bool cut_saturated;                   // Controller saturated during the stroke
 } marks_monitor_t;
 
 typedef enum {
@@ -55,10 +73,7 @@ typedef enum {
     CUT_AWAIT_POSITION,           // Waiting to reach cutting position
     
     // Cutting sequence states
-    CUT_BEGIN_SEQUENCE,           // Starting the cut sequence
-    CUT_REACH_EDGE,              // Continuing cut sequence
-    CUT_RETURN_CENTER,           // Moving back to mark after first cut
-    CUT_FINISH_SEQUENCE,         // Cutting remaining section
+    CUT_BEGIN_SEQUENCE,           // Queue the whole cut stroke on the cutter
     
     // Next cycle preparation states
     PREP_NEXT_CYCLE,             // Moving to starting position for next cut
@@ -78,11 +93,21 @@ automatic_substate_t automatic_substate;
 marks_monitor_t monitor_data;
 
 void stop_knife_on_mark(void) {
-    servo_set_stop_position(devices.servo_feeder, get_mark_position() + SENSOR_KNIFE_OFFSET_Y);
+    servo_retarget(devices.servo_feeder, get_mark_position() + SENSOR_KNIFE_OFFSET_Y);
 }
 
 void stop_knife_between_marks(void) {
-    servo_set_stop_position(devices.servo_feeder, get_mark_position() + SENSOR_KNIFE_OFFSET_Y + (monitor_data.mark_distance / 2.0));
+    servo_retarget(devices.servo_feeder, get_mark_position() + SENSOR_KNIFE_OFFSET_Y + (monitor_data.mark_distance / 2.0));
+}
+
+// Feeder position zero follows the paper, positions stay small on a roll of any length
+void move_feeder_origin(void) {
+    float shift = servo_shift_origin(devices.servo_feeder, servo_get_position(devices.servo_feeder));
+    detector_shift_positions(shift);
+    monitor_data.first_mark_position -= shift;
+    monitor_data.second_mark_position -= shift;
+    monitor_data.third_mark_position -= shift;
+    monitor_data.last_stop_position -= shift;
 }
 
 void reset_paper_mark_positions(void) {
@@ -93,6 +118,45 @@ bool is_paper_positions_set(void) {
     return machine.paper_right_mark_position != 0.0;
 }
 
+void reset_cut_tracking(void) {
+    monitor_data.cut_error_peak = 0.0;
+    monitor_data.cut_duty_peak = 0.0;
+    monitor_data.cut_sampled = false;
+    monitor_data.cut_saturated = false;
+}
+
+// Tracking of the cutter at cut speed with the knife in the material
+void sample_cut_tracking(void) {
+    servo_t* const cutter = devices.servo_cutter;
+    if (!knife_is_down() || !servo_is_speed_reached(cutter)) {
+        return;
+    }
+
+    const float limit = servo_get_following_error_limit(cutter);
+    const float error = limit > 0.0f ? fabsf(servo_get_following_error(cutter)) / limit : 0.0f;
+    const float duty = fabsf(servo_get_duty(cutter));
+    monitor_data.cut_error_peak = fmaxf(monitor_data.cut_error_peak, error);
+    monitor_data.cut_duty_peak = fmaxf(monitor_data.cut_duty_peak, duty);
+    monitor_data.cut_saturated |= servo_is_saturated(cutter);
+    monitor_data.cut_sampled = true;
+}
+
+// Raises the cut speed after a stroke with good tracking and enough headroom,
+// backs off when the error or the drag of the material grows
+void update_cut_speed(void) {
+    if (!monitor_data.cut_sampled) {
+        return;
+    }
+
+    if (monitor_data.cut_saturated || monitor_data.cut_error_peak > CUT_ERROR_POOR ||
+        monitor_data.cut_duty_peak > CUT_DUTY_POOR) {
+        monitor_data.cut_speed = fmaxf(monitor_data.cut_speed * CUT_SPEED_BACKOFF, AUTOMAT_SPEED_CUT_MIN);
+    } else if (monitor_data.cut_error_peak < CUT_ERROR_GOOD && monitor_data.cut_duty_peak < CUT_DUTY_GOOD) {
+        monitor_data.cut_speed = fminf(monitor_data.cut_speed * CUT_SPEED_RAISE, AUTOMAT_SPEED_CUT_MAX);
+    }
+    reset_cut_tracking();
+}
+
 void activate_automatic_state() {
     machine_state = AUTOMAT;
     automatic_substate = IDLE;
@@ -105,6 +169,15 @@ void activate_automatic_state() {
     monitor_data.mark_distance = 0.0;
     monitor_data.current_sticker_measurement = 0.0;
     monitor_data.sticker_dimensions_set = false;
+
+    // Every job starts cutting at the default speed, the learned speed is
+    // kept when the same paper marks are set again after a stop
+    if (monitor_data.cut_speed == 0.0 ||
+        fabsf(machine.paper_right_mark_position - monitor_data.cut_job_mark) > CUT_JOB_TOLERANCE) {
+        monitor_data.cut_speed = AUTOMAT_SPEED_CUT;
+        monitor_data.cut_job_mark = machine.paper_right_mark_position;
+    }
+    reset_cut_tracking();
 }
 
 void handle_automatic_state(void) {
@@ -129,15 +202,15 @@ void handle_automatic_state(void) {
 // ----------------------------------------------------------------------------------------------------------
 // Navigate cutting head to the mark position
         case MARK_SEEK_START:
-            if (servo_is_idle(devices.servo_cutter)) {
-                servo_goto_delayed(devices.servo_cutter, machine.paper_right_mark_position, AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY);
+            if (servo_is_settled(devices.servo_cutter)) {
+                servo_goto(devices.servo_cutter, machine.paper_right_mark_position, AUTOMAT_SPEED_FAST);
                 automatic_substate = MARK_SEEK_MOVING;
             }
             break;
 
         case MARK_SEEK_MOVING:
             set_text_10(machine.F2_text, "K znacke");
-            if (servo_is_idle(devices.servo_cutter)) {
+            if (servo_is_settled(devices.servo_cutter)) {
                 automatic_substate = MARK_SEEK_READY;
             }
             break;
@@ -150,7 +223,10 @@ void handle_automatic_state(void) {
 // ----------------------------------------------------------------------------------------------------------
 // Rolling paper at constant speed
         case PAPER_START_FEED:
-            servo_goto_delayed(devices.servo_feeder, FAR_AWAY_DISTANCE, AUTOMAT_SPEED_SCAN, HALF_SECOND_DELAY);
+            if (monitor_data.sticker_dimensions_set) {
+                move_feeder_origin();
+            }
+            servo_goto(devices.servo_feeder, servo_get_position(devices.servo_feeder) + FAR_AWAY_DISTANCE, AUTOMAT_SPEED_SCAN);
             automatic_substate = PAPER_AWAIT_SPEED;
             break;
 
@@ -234,7 +310,7 @@ void handle_automatic_state(void) {
             set_text_20(machine.state_text_2, state_text_2);
 
             set_text_10(machine.F2_text, "    Potvrd");
-            if (servo_is_idle(devices.servo_feeder) && button_raised(devices.F2)) {
+            if (servo_is_settled(devices.servo_feeder) && button_raised(devices.F2)) {
                 monitor_data.sticker_dimensions_set = true;
                 automatic_substate = CUT_MOVE_TO_START;
             }
@@ -242,7 +318,7 @@ void handle_automatic_state(void) {
 
         case CUT_STOP_AT_MARK:
             stop_knife_between_marks();
-            if (servo_is_idle(devices.servo_feeder)) {
+            if (servo_is_settled(devices.servo_feeder)) {
                 if (monitor_data.current_sticker_measurement <= monitor_data.sticker_height + STICKER_HEIGHT_TOLERNACE) {
                     automatic_substate = MONITOR_STICKER_HEIGHT_FAILURE;
                 }
@@ -257,12 +333,12 @@ void handle_automatic_state(void) {
 // Navigate cutting head to the cut position and perform the cut
         case CUT_MOVE_TO_START:
             set_text_20(machine.state_text_1, "Automat");
-            servo_goto_delayed(devices.servo_feeder, monitor_data.third_mark_position - monitor_data.mark_distance / 2.0, AUTOMAT_SPEED_MID, HALF_SECOND_DELAY);
+            servo_goto(devices.servo_feeder, monitor_data.third_mark_position - monitor_data.mark_distance / 2.0, AUTOMAT_SPEED_MID);
             automatic_substate = CUT_AWAIT_POSITION;
             break;
 
         case CUT_AWAIT_POSITION:
-            if (servo_is_idle(devices.servo_feeder)) {
+            if (servo_is_settled(devices.servo_feeder)) {
                 set_text_10(machine.F2_text, " Rezat! :)");
                 if (button_raised(devices.F2)) {
                     automatic_substate = CUT_BEGIN_SEQUENCE;
@@ -270,50 +346,43 @@ void handle_automatic_state(void) {
             }
             break;
             
+        // Cut stroke: into the paper next to the mark, cut to the right edge,
+        // back to the mark and cut to the left edge. Every leg after the first
+        // reverses or waits for the knife, so none of them blend. Queueing
+        // only saves the round trips through this state machine.
         case CUT_BEGIN_SEQUENCE:
             set_text_10(machine.F2_text, "");
-            if (servo_is_idle(devices.servo_cutter)) {
-                servo_goto_delayed(devices.servo_cutter, machine.paper_right_mark_position - 50.0, AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY);
-                automatic_substate = CUT_REACH_EDGE;
-
-            }
-            break;
-
-        case CUT_REACH_EDGE:
-            if (servo_is_idle(devices.servo_cutter)) {
-                knife_down();
-                servo_goto_delayed(devices.servo_cutter, POSITION_EDGE_RIGHT, AUTOMAT_SPEED_CUT, HALF_SECOND_DELAY);
-                automatic_substate = CUT_RETURN_CENTER;
-            }
-            break;
-
-        case CUT_RETURN_CENTER:
-            if (servo_is_idle(devices.servo_cutter)) {
-                knife_up();
-                servo_goto_delayed(devices.servo_cutter, machine.paper_right_mark_position - 50 , AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY);
-                automatic_substate = CUT_FINISH_SEQUENCE;
-            }
-            break;
-
-        case CUT_FINISH_SEQUENCE:
-            if (servo_is_idle(devices.servo_cutter)) {
-                knife_down();
-                servo_goto_delayed(devices.servo_cutter, POSITION_EDGE_LEFT, AUTOMAT_SPEED_CUT, HALF_SECOND_DELAY);
+            if (servo_is_settled(devices.servo_cutter)) {
+                // Dwells after knife_down and knife_up give the knife time to move
+                servo_queue_move(devices.servo_cutter, machine.paper_right_mark_position - 50.0, AUTOMAT_SPEED_FAST, 0, NULL);
+                reset_cut_tracking();
+                servo_queue_move(devices.servo_cutter, POSITION_EDGE_RIGHT, monitor_data.cut_speed, HALF_SECOND_DELAY, knife_down);
+                servo_queue_move(devices.servo_cutter, machine.paper_right_mark_position - 50.0, AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY, knife_up);
+                servo_queue_move(devices.servo_cutter, POSITION_EDGE_LEFT, monitor_data.cut_speed, HALF_SECOND_DELAY, knife_down);
                 automatic_substate = PREP_NEXT_CYCLE;
             }
             break;
 
         case PREP_NEXT_CYCLE:
-            if (servo_is_idle(devices.servo_cutter)) {
+            snprintf(state_text_2, sizeof(state_text_2), "Rez: %.0fmm/s", monitor_data.cut_speed);
+            set_text_20(machine.state_text_2, state_text_2);
+            sample_cut_tracking();
+            if (servo_is_settled(devices.servo_cutter)) {
                 knife_up();
-                servo_goto_delayed(devices.servo_cutter, machine.paper_right_mark_position, AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY);
-                servo_goto_delayed(devices.servo_feeder, (servo_get_position(devices.servo_feeder) + (monitor_data.mark_distance / 2)), AUTOMAT_SPEED_FAST, HALF_SECOND_DELAY);
+                update_cut_speed();
+                // Both axes arrive together, the shorter move runs slower and gentler.
+                // The delay lets the knife lift before the paper moves.
+                servo_t* const servos[2] = {devices.servo_cutter, devices.servo_feeder};
+                const float positions[2] = {machine.paper_right_mark_position,
+                                            servo_get_position(devices.servo_feeder) + (monitor_data.mark_distance / 2)};
+                const float speeds[2] = {AUTOMAT_SPEED_FAST, AUTOMAT_SPEED_FAST};
+                servo_goto_synchronized(servos, positions, speeds, 2, HALF_SECOND_DELAY);
                 automatic_substate = PREP_NEW_DETECTION;
             }
             break;
 
         case PREP_NEW_DETECTION:
-            if (servo_is_idle(devices.servo_cutter) && servo_is_idle(devices.servo_feeder)) {
+            if (servo_is_settled(devices.servo_cutter) && servo_is_settled(devices.servo_feeder)) {
                 automatic_substate = PAPER_START_FEED;
             }
             break;
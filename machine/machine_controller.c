@@ -11,6 +11,7 @@
 #include "machine_controller.h"
 #include "machine_manual_mode.h"
 #include "machine_automatic_mode.h"
+#include "machine_tuning_mode.h"
 #include "../servo_motor/servo_motor.h"
 #include "../servo_motor/button.h"
 #include "mark_detector.h"
@@ -19,6 +20,46 @@
 #define KNIFE_OUTPUT_PIN 17
 #define SCALE_CUTTER 20.0
 #define SCALE_FEEDER 6.4
+#define JERK_CUTTER 40000.0
+#define JERK_FEEDER 12800.0
+#define KVFF_CUTTER 1.0
+#define KVFF_FEEDER 1.0
+#define KAFF_CUTTER 0.05
+#define KAFF_FEEDER 0.1
+
+// Following error envelope of the feeder, standstill limit in mm, allowances
+// in s and s^2. Cutter keeps the default envelope of the servo.
+#define FE_STATIC_FEEDER 2.0
+#define FE_SPEED_FEEDER 0.02
+#define FE_ACC_FEEDER 0.003
+
+// In position window in mm, speed threshold in mm/s, cycles in the window
+#define SETTLE_WINDOW_CUTTER 0.1
+#define SETTLE_WINDOW_FEEDER 0.05
+#define SETTLE_SPEED_CUTTER 2.0
+#define SETTLE_SPEED_FEEDER 1.0
+#define SETTLE_TICKS 20
+
+// Feeder backlash in mm, measured in the tuning mode
+#define BACKLASH_FEEDER 0.0
+
+// Friction map of the cutter rail, one bin per 10mm
+#define FRICTION_BINS_CUTTER 144
+
+// Profile cache of the cutter, a strip needs ~60 blocks of 256ms
+#define PROFILE_CACHE_BLOCKS_CUTTER 80
+
+// Thermal time constant of motor and driver in s, duty they take continuously
+#define THERMAL_TIME_CUTTER 30.0
+#define THERMAL_TIME_FEEDER 30.0
+#define THERMAL_DUTY_CUTTER 0.5
+#define THERMAL_DUTY_FEEDER 0.5
+
+// PWM frequency in Hz and counter cycles per period
+#define PWM_FREQUENCY_CUTTER 20000.0
+#define PWM_FREQUENCY_FEEDER 20000.0
+#define PWM_RESOLUTION_CUTTER 1024
+#define PWM_RESOLUTION_FEEDER 1024
 
 // LCD display configuration
 #define DISPLAY_COLS 20
@@ -43,6 +84,7 @@ machine_t machine;
 // First pin of PWM couple.
 #define PWM_0 18
 #define PWM_1 20
+
 void machine_init(void) {
     // Initialize machine state
     machine_state = MANUAL;
@@ -62,12 +104,31 @@ void machine_init(void) {
     set_text_20(machine.error_message, "OK");
     set_text_20(machine.state_text_2, "");
 
-    // Init PIO
+    // Init PIO, the encoder program fills pio0 so edge periods are measured on pio1
     int offset = pio_add_program(pio0, &quadrature_encoder_program);
+    int period_offset = pio_add_program(pio1, &quadrature_period_program);
 
     // Create servos
-    devices.servo_cutter = servo_create("Cutter", offset, 0, ENC_0, PWM_0, SCALE_CUTTER, devices.Right, devices.Left, &machine.enable, &machine.machine_error, &machine.error_message);
-    devices.servo_feeder = servo_create("Feeder", offset, 1, ENC_1, PWM_1, SCALE_FEEDER, devices.Out, devices.In, &machine.enable, &machine.machine_error, &machine.error_message);
+    devices.servo_cutter = servo_create("Cutter", offset, period_offset, 0, ENC_0, PWM_0, SCALE_CUTTER, KVFF_CUTTER, KAFF_CUTTER, devices.Right, devices.Left, &machine.enable, &machine.machine_error, &machine.error_message);
+    devices.servo_feeder = servo_create("Feeder", offset, period_offset, 1, ENC_1, PWM_1, SCALE_FEEDER, KVFF_FEEDER, KAFF_FEEDER, devices.Out, devices.In, &machine.enable, &machine.machine_error, &machine.error_message);
+
+    // Jerk-limited profiles, acceleration ramps up in ~50ms
+    servo_set_profile(devices.servo_cutter, PROFILE_S_CURVE, JERK_CUTTER);
+    servo_set_profile(devices.servo_feeder, PROFILE_S_CURVE, JERK_FEEDER);
+
+    servo_set_following_error_limits(devices.servo_feeder, FE_STATIC_FEEDER, FE_SPEED_FEEDER, FE_ACC_FEEDER);
+    servo_set_settle_window(devices.servo_cutter, SETTLE_WINDOW_CUTTER, SETTLE_SPEED_CUTTER, SETTLE_TICKS);
+    servo_set_settle_window(devices.servo_feeder, SETTLE_WINDOW_FEEDER, SETTLE_SPEED_FEEDER, SETTLE_TICKS);
+
+    servo_set_backlash(devices.servo_feeder, BACKLASH_FEEDER);
+    servo_set_friction_range(devices.servo_cutter, POSITION_EDGE_LEFT, POSITION_EDGE_RIGHT, FRICTION_BINS_CUTTER);
+    servo_enable_profile_cache(devices.servo_cutter, PROFILE_CACHE_BLOCKS_CUTTER);
+
+    servo_set_thermal_model(devices.servo_cutter, THERMAL_TIME_CUTTER, THERMAL_DUTY_CUTTER);
+    servo_set_thermal_model(devices.servo_feeder, THERMAL_TIME_FEEDER, THERMAL_DUTY_FEEDER);
+
+    servo_set_pwm(devices.servo_cutter, PWM_FREQUENCY_CUTTER, PWM_RESOLUTION_CUTTER);
+    servo_set_pwm(devices.servo_feeder, PWM_FREQUENCY_FEEDER, PWM_RESOLUTION_FEEDER);
 
     // Create lcd
     devices.lcd = lcd_create(
@@ -89,15 +150,17 @@ void machine_init(void) {
     // Cutter
     machine.params_ready = false;
 
-    // Mark probe
-    init_detector(0, servo_get_position_pointer(devices.servo_feeder), &machine.machine_error, &machine.error_message);
+    // Mark probe, positions are stored in the 4000 encoder counts of a feeder rev
+    init_detector(0, servo_get_position_pointer(devices.servo_feeder), SCALE_FEEDER / 4000.0f, &machine.machine_error, &machine.error_message);
 
     // Machine states
     activate_manual_state();
 }
 
 void machine_compute(void) {
-    // Update I/devices
+    // Update I/devices, both encoders are sampled at the same instant
+    servo_latch_encoder(devices.servo_cutter);
+    servo_latch_encoder(devices.servo_feeder);
     servo_compute(devices.servo_cutter);
     servo_compute(devices.servo_feeder);
     button_compute(devices.F1);
@@ -117,6 +180,7 @@ void machine_compute(void) {
     switch(machine_state) {
         case MANUAL:    handle_manual_state(); break;
         case HOMING:    handle_homing_state(); break;
+        case TUNING:    handle_tuning_state(); break;
         case AUTOMAT:   handle_automatic_state(); break;
         case FAILURE:   handle_failure_state(); break;
     }
@@ -148,6 +212,10 @@ void knife_down(void) {
     gpio_put(KNIFE_OUTPUT_PIN, true);
 }
 
+bool knife_is_down(void) {
+    return gpio_get_out_level(KNIFE_OUTPUT_PIN);
+}
+
 void raise_error(char text[]) {
     set_text_20(machine.error_message, text);
     machine.machine_error = true;
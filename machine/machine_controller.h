@@ -13,7 +13,7 @@
 // Physical constants
 #define SENSOR_KNIFE_OFFSET_X 25.0f
 #define SENSOR_KNIFE_OFFSET_Y 14.0f
-#define FAR_AWAY_DISTANCE 1000.0f
+#define FAR_AWAY_DISTANCE 1000.0f // Feed length while scanning for a mark
 #define POSITION_EDGE_RIGHT -45.0f
 #define POSITION_EDGE_LEFT -1480.0f
 
@@ -27,6 +27,8 @@
 #define AUTOMAT_SPEED_NORMAL 200.0f
 #define AUTOMAT_SPEED_FAST 250.0f
 #define AUTOMAT_SPEED_CUT 180.0f
+#define AUTOMAT_SPEED_CUT_MIN 100.0f	// Cut speed governor backs off down to this speed
+#define AUTOMAT_SPEED_CUT_MAX 250.0f	// and raises the cut speed up to this one, at most AUTOMAT_SPEED_FAST
 
 #define HALF_SECOND_DELAY 500
 
@@ -34,6 +36,7 @@ typedef enum {
 	MANUAL,
 	HOMING,
 	PARAMS,
+	TUNING,
 	AUTOMAT, 
 	FAILURE
 } machine_state_t;
@@ -114,6 +117,12 @@ void knife_up(void);
  */
 void knife_down(void);
 
+/**
+ * @brief Checks if the cutting knife is lowered
+ * @return true while the knife is down
+ */
+bool knife_is_down(void);
+
 /**
  * @brief Sets error state with message
  * @param text Error message text
@@ -4,6 +4,7 @@
 #include "machine_controller.h"
 #include "machine_manual_mode.h"
 #include "machine_automatic_mode.h"
+#include "machine_tuning_mode.h"
 #include "../servo_motor/servo_motor.h"
 #include "../servo_motor/button.h"
 #include "mark_detector.h"
@@ -22,6 +23,9 @@ typedef enum {
     HOMING_SCANNING,          // Moving servo while scanning for home position
     HOMING_FOUND,            // Home position detected, stopping motion
     HOMING_RETURN_TO_ZERO,   // Moving back to define zero position
+    HOMING_LEARN_START,      // Starting to learn the friction of the rail
+    HOMING_LEARN_LEFT,       // Traversing the rail to the left edge at cut speed
+    HOMING_LEARN_RIGHT,      // Traversing the rail back to the right edge
     HOMING_FINISHED          // Homing sequence completed
 } homing_substate_t;
 
@@ -34,6 +38,10 @@ void activate_homing_state(void) {
 }
 
 void activate_manual_state(void) {
+    // Drop remaining automatic movements, the active one is finished
+    servo_queue_clear(devices.servo_cutter);
+    servo_queue_clear(devices.servo_feeder);
+
     machine.paper_right_mark_position = 0.0;
     manual_substate = MANUAL_READY;
     machine_state = MANUAL;
@@ -71,7 +79,16 @@ void handle_manual_state(void) {
     // Handle state transitions
     switch(manual_substate) {
         case MANUAL_IDLE:
-            set_text_10(machine.F2_text, "");
+            // Experiments move the axis, only on a homed machine away from the edges
+            if (tuning_is_allowed()) {
+                set_text_10(machine.F2_text, "   Ladenie");
+                if (button_raised(devices.F2)) {
+                    activate_tuning_state();
+                }
+            }
+            else {
+                set_text_10(machine.F2_text, "");
+            }
             break;
 
         case MANUAL_READY:
@@ -131,14 +148,16 @@ void handle_homing_state(void) {
 
     set_text_10(machine.F1_text, "Stop");
     if (button_raised(devices.F1)) {
+        servo_stop_positioning(devices.servo_cutter);
+        servo_friction_learn_finish(devices.servo_cutter);
         activate_manual_state();
     }
 
     // Handle state transitions
     switch(homing_substate) {
         case HOMING_START:
-            if (servo_is_idle(devices.servo_cutter)) {
-                servo_goto_delayed(devices.servo_cutter, 2000.0, 100.0, HALF_SECOND_DELAY);
+            if (servo_is_settled(devices.servo_cutter)) {
+                servo_goto(devices.servo_cutter, 2000.0, 100.0);
                 homing_substate = HOMING_SCANNING;
             }
             break;
@@ -160,11 +179,44 @@ void handle_homing_state(void) {
             break;
 
         case HOMING_RETURN_TO_ZERO:
-            if (servo_is_idle(devices.servo_cutter)) {
+            if (servo_is_settled(devices.servo_cutter)) {
                 servo_set_zero_position(devices.servo_cutter);
-                servo_goto_delayed(devices.servo_cutter, -50.0, 100.0, HALF_SECOND_DELAY);
+                servo_goto(devices.servo_cutter, -50.0, 100.0);
             }
             else if (servo_is_position_reached(devices.servo_cutter)) {
+#ifdef FRICTION_LEARNING
+                homing_substate = HOMING_LEARN_START;
+#else
+                homing_substate = HOMING_FINISHED;
+#endif
+            }
+            break;
+
+        // Friction is learned at cut speed, the map is exact where it matters most
+        case HOMING_LEARN_START:
+            if (servo_is_settled(devices.servo_cutter)) {
+                if (servo_friction_learn_start(devices.servo_cutter)) {
+                    servo_goto(devices.servo_cutter, POSITION_EDGE_LEFT, AUTOMAT_SPEED_CUT);
+                    homing_substate = HOMING_LEARN_LEFT;
+                }
+                else {
+                    homing_substate = HOMING_FINISHED;
+                }
+            }
+            break;
+
+        case HOMING_LEARN_LEFT:
+            set_text_10(machine.F2_text, "Trenie <-");
+            if (servo_is_settled(devices.servo_cutter)) {
+                servo_goto(devices.servo_cutter, POSITION_EDGE_RIGHT, AUTOMAT_SPEED_CUT);
+                homing_substate = HOMING_LEARN_RIGHT;
+            }
+            break;
+
+        case HOMING_LEARN_RIGHT:
+            set_text_10(machine.F2_text, "Trenie ->");
+            if (servo_is_settled(devices.servo_cutter)) {
+                servo_friction_learn_finish(devices.servo_cutter);
                 homing_substate = HOMING_FINISHED;
             }
             break;
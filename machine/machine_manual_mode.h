@@ -26,7 +26,9 @@ void handle_manual_state(void);
  * 2. Moves servo to find home position
  * 3. Detects home position
  * 4. Sets zero position
- * 5. Returns to manual mode when complete
+ * 5. Traverses the rail both ways to learn the friction map of the cutter,
+ *    only when built with FRICTION_LEARNING
+ * 6. Returns to manual mode when complete
  */
 void handle_homing_state(void);
 
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "machine_controller.h"
+#include "machine_manual_mode.h"
+#include "machine_tuning_mode.h"
+#include "../servo_motor/servo_motor.h"
+#include "../servo_motor/button.h"
+#include "mark_detector.h"
+
+#define TUNE_RELAY_PWM 150.0f		// Relay amplitude of velocity loop experiment
+#define TUNE_RELAY_SPEED 20.0f		// Relay amplitude of position loop experiment in mm/s
+#define TUNE_TRAVEL 30.0f			// Permitted travel from the start position in mm
+#define BACKLASH_SCAN_TRAVEL 200.0f	// Feed length while looking for a mark in mm
+#define BACKLASH_RUNUP 10.0f		// Distance past the mark before turning back in mm
+#define BACKLASH_MAX 2.0f			// Larger measured lash is not trusted, in mm
+#define DETECTOR_SAMPLE_TIME 0.001f	// detector_compute runs once per cycle
+
+typedef enum {
+    TUNING_SELECT,      // Choosing the axis, motors enabled and holding position
+    TUNING_BREAKAWAY,   // Ramping duty until the axis moves, both directions
+    TUNING_VELOCITY,    // Relay experiment on velocity loop
+    TUNING_POSITION,    // Relay experiment on position loop
+    TUNING_CONFIRM,     // Proposed gains shown, waiting for the operator
+    TUNING_DONE,        // Gains of both loops applied
+    BACKLASH_FORWARD,   // Feeding forward over a mark
+    BACKLASH_RETURN,    // Stopping past the mark before turning back
+    BACKLASH_BACKWARD,  // Feeding backward over the same mark
+    BACKLASH_DONE,      // Lash measured and compensated
+    TUNING_FAILED       // Experiment stopped or the axis did not oscillate
+} tuning_substate_t;
+
+typedef enum {
+    TARGET_CUTTER,      // Gains of the cutter
+    TARGET_FEEDER,      // Gains of the feeder
+    TARGET_BACKLASH,    // Backlash of the feeder
+    TARGET_COUNT
+} tuning_target_t;
+
+tuning_substate_t tuning_substate;
+static tuning_target_t tuning_target;
+
+// Backlash measurement
+static bool backlash_sampling;      // Detector restarted at scan speed
+static float backlash_previous;     // Restored when the measurement fails
+static float mark_forward;          // Mark position seen while feeding forward
+
+// Results shown when finished
+static float velocity_ku;
+static float velocity_tu;
+
+// Gains restored when the tuning fails or its result is rejected
+static servo_gains_t gains_previous;
+
+servo_t* tuned_servo(void) {
+    return tuning_target == TARGET_CUTTER ? devices.servo_cutter : devices.servo_feeder;
+}
+
+// Starts a pass over the mark at scan speed
+void backlash_scan_start(const float position) {
+    servo_goto(devices.servo_feeder, position, AUTOMAT_SPEED_SCAN);
+    backlash_sampling = false;
+}
+
+// True when the pass has detected the mark, detector is restarted once the speed is constant
+bool backlash_scan(void) {
+    if (!backlash_sampling) {
+        if (servo_is_speed_reached(devices.servo_feeder)) {
+            detector_restart();
+            backlash_sampling = true;
+        }
+        return false;
+    }
+    return is_sampling_done() && detect_mark();
+}
+
+bool tuning_is_allowed(void) {
+    const float position = servo_get_position(devices.servo_cutter);
+    return machine.homed &&
+           position >= POSITION_EDGE_LEFT + TUNE_TRAVEL &&
+           position <= POSITION_EDGE_RIGHT - TUNE_TRAVEL;
+}
+
+void tuning_fail(void) {
+    servo_set_gains(tuned_servo(), &gains_previous);
+    tuning_substate = TUNING_FAILED;
+}
+
+void backlash_fail(void) {
+    servo_stop_positioning(devices.servo_feeder);
+    servo_set_backlash(devices.servo_feeder, backlash_previous);
+    tuning_substate = TUNING_FAILED;
+}
+
+void activate_tuning_state(void) {
+    servo_queue_clear(devices.servo_cutter);
+    servo_queue_clear(devices.servo_feeder);
+
+    tuning_substate = TUNING_SELECT;
+    machine_state = TUNING;
+    machine.enable = true;
+}
+
+void handle_tuning_state(void) {
+    char text[21];
+    servo_gains_t gains;
+    float kp, ki, kd;
+    servo_t* const servo = tuned_servo();
+
+    switch(tuning_target) {
+        case TARGET_CUTTER:     set_text_20(machine.state_text_1, "Ladenie: Cutter"); break;
+        case TARGET_FEEDER:     set_text_20(machine.state_text_1, "Ladenie: Feeder"); break;
+        default:                set_text_20(machine.state_text_1, "Vola: Feeder"); break;
+    }
+
+    switch(tuning_substate) {
+        case TUNING_SELECT:
+            set_text_20(machine.state_text_2, "<- -> vyber osi");
+            set_text_10(machine.F1_text, "Spat");
+            set_text_10(machine.F2_text, "     Start");
+            if (button_raised(devices.Right)) {
+                tuning_target = (tuning_target + 1) % TARGET_COUNT;
+            }
+            else if (button_raised(devices.Left)) {
+                tuning_target = (tuning_target + TARGET_COUNT - 1) % TARGET_COUNT;
+            }
+            if (button_raised(devices.F1)) {
+                activate_manual_state();
+            }
+            else if (button_raised(devices.F2) && tuning_target == TARGET_BACKLASH) {
+                // Measured without compensation, the lash shows up in full
+                if (servo_is_settled(servo)) {
+                    backlash_previous = servo_get_backlash(servo);
+                    servo_set_backlash(servo, 0.0f);
+                    backlash_scan_start(servo_get_position(servo) + BACKLASH_SCAN_TRAVEL);
+                    tuning_substate = BACKLASH_FORWARD;
+                }
+            }
+            else if (button_raised(devices.F2)) {
+                if (servo_calibrate_output_start(servo, TUNE_TRAVEL)) {
+                    servo_get_gains(servo, &gains_previous);
+                    tuning_substate = TUNING_BREAKAWAY;
+                }
+            }
+            break;
+
+        // Gains are tuned with the deadzone already compensated
+        case TUNING_BREAKAWAY:
+            set_text_20(machine.state_text_2, "Rozbeh motora");
+            set_text_10(machine.F1_text, "Stop");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                servo_calibrate_output_abort(servo);
+            }
+            if (servo_calibrate_output_get_state(servo) == AUTOTUNE_FINISHED) {
+                servo_calibrate_output_apply(servo);
+                if (servo_autotune_start(servo, SERVO_LOOP_VELOCITY, TUNE_RELAY_PWM, TUNE_TRAVEL)) {
+                    tuning_substate = TUNING_VELOCITY;
+                }
+            }
+            else if (servo_calibrate_output_get_state(servo) == AUTOTUNE_FAILED) {
+                tuning_fail();
+            }
+            break;
+
+        case TUNING_VELOCITY:
+            set_text_20(machine.state_text_2, "Rychlostna slucka");
+            set_text_10(machine.F1_text, "Stop");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                servo_autotune_abort(servo);
+            }
+            if (servo_autotune_get_state(servo) == AUTOTUNE_FINISHED) {
+                // Position experiment runs over the tuned velocity loop
+                velocity_ku = servo_autotune_get_ku(servo);
+                velocity_tu = servo_autotune_get_tu(servo);
+                servo_autotune_apply(servo);
+                if (servo_autotune_start(servo, SERVO_LOOP_POSITION, TUNE_RELAY_SPEED, TUNE_TRAVEL)) {
+                    tuning_substate = TUNING_POSITION;
+                }
+            }
+            else if (servo_autotune_get_state(servo) == AUTOTUNE_FAILED) {
+                tuning_fail();
+            }
+            break;
+
+        case TUNING_POSITION:
+            set_text_20(machine.state_text_2, "Polohova slucka");
+            set_text_10(machine.F1_text, "Stop");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                servo_autotune_abort(servo);
+            }
+            if (servo_autotune_get_state(servo) == AUTOTUNE_FINISHED) {
+                tuning_substate = TUNING_CONFIRM;
+            }
+            else if (servo_autotune_get_state(servo) == AUTOTUNE_FAILED) {
+                tuning_fail();
+            }
+            break;
+
+        // Velocity gains / position gains, Kp Ki Kd. Rejected gains are
+        // replaced by the ones from before the tuning.
+        case TUNING_CONFIRM:
+            servo_get_gains(servo, &gains);
+            servo_autotune_get_gains(servo, &kp, &ki, &kd);
+            snprintf(text, sizeof(text), "V %.2f %.3f %.2f", gains.vel_kp, gains.vel_ki, gains.vel_kd);
+            set_text_20(machine.state_text_1, text);
+            snprintf(text, sizeof(text), "P %.1f %.2f %.2f", kp, ki, kd);
+            set_text_20(machine.state_text_2, text);
+            set_text_10(machine.F1_text, "Zrusit");
+            set_text_10(machine.F2_text, "    Potvrd");
+            if (button_raised(devices.F1)) {
+                servo_set_gains(servo, &gains_previous);
+                tuning_substate = TUNING_SELECT;
+            }
+            else if (button_raised(devices.F2)) {
+                servo_autotune_apply(servo);
+#ifdef FEEDER_GAIN_SCHEDULE
+                // Feeder gains are kept for the inertia of the current roll
+                if (tuning_target == TARGET_FEEDER) {
+                    servo_store_gain_set(servo);
+                }
+#endif
+                tuning_substate = TUNING_DONE;
+            }
+            break;
+
+        case TUNING_DONE:
+            // Ultimate gain / period in ms of both loops
+            snprintf(text, sizeof(text), "V%.1f/%.0f P%.1f/%.0f",
+                velocity_ku, velocity_tu * 1000.0f,
+                servo_autotune_get_ku(servo), servo_autotune_get_tu(servo) * 1000.0f);
+            set_text_20(machine.state_text_2, text);
+            set_text_10(machine.F1_text, "Spat");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                activate_manual_state();
+            }
+            break;
+
+        // Mark under the sensor is seen with the motor ahead of the paper by
+        // half of the lash in each direction. The detector reports the mark
+        // late by its filter delay, also in the direction of movement.
+        case BACKLASH_FORWARD:
+            set_text_20(machine.state_text_2, "Znacka vpred");
+            set_text_10(machine.F1_text, "Stop");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                backlash_fail();
+            }
+            else if (backlash_scan()) {
+                mark_forward = get_mark_position();
+                servo_retarget(servo, mark_forward + BACKLASH_RUNUP);
+                tuning_substate = BACKLASH_RETURN;
+            }
+            else if (servo_is_idle(servo)) {
+                backlash_fail();
+            }
+            break;
+
+        case BACKLASH_RETURN:
+            if (button_raised(devices.F1)) {
+                backlash_fail();
+            }
+            else if (servo_is_settled(servo)) {
+                backlash_scan_start(mark_forward - BACKLASH_RUNUP);
+                tuning_substate = BACKLASH_BACKWARD;
+            }
+            break;
+
+        case BACKLASH_BACKWARD:
+            set_text_20(machine.state_text_2, "Znacka vzad");
+            if (button_raised(devices.F1)) {
+                backlash_fail();
+            }
+            else if (backlash_scan()) {
+                const float lag = AUTOMAT_SPEED_SCAN * detector_get_delay() * DETECTOR_SAMPLE_TIME;
+                const float lash = mark_forward - get_mark_position() - 2.0f * lag;
+                servo_stop_positioning(servo);
+                if (lash > BACKLASH_MAX) {
+                    backlash_fail();
+                }
+                else {
+                    servo_set_backlash(servo, lash > 0.0f ? lash : 0.0f);
+                    tuning_substate = BACKLASH_DONE;
+                }
+            }
+            else if (servo_is_idle(servo)) {
+                backlash_fail();
+            }
+            break;
+
+        case BACKLASH_DONE:
+            snprintf(text, sizeof(text), "Vola: %.2fmm", servo_get_backlash(servo));
+            set_text_20(machine.state_text_2, text);
+            set_text_10(machine.F1_text, "Spat");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                activate_manual_state();
+            }
+            break;
+
+        case TUNING_FAILED:
+            set_text_20(machine.state_text_2, "Ladenie zlyhalo");
+            set_text_10(machine.F1_text, "Spat");
+            set_text_10(machine.F2_text, "");
+            if (button_raised(devices.F1)) {
+                activate_manual_state();
+            }
+            break;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MACHINE_TUNING_MODE_H
+#define MACHINE_TUNING_MODE_H
+
+#include <stdbool.h>
+#include "../servo_motor/servo_motor.h"
+
+/**
+ * @brief Activates the PID auto-tuning mode
+ * @details Sets the machine state to TUNING, enables motors and waits for
+ * the axis to be selected
+ */
+void activate_tuning_state(void);
+
+/**
+ * @brief Checks if the auto-tuning mode may be started
+ * @return true if the machine is homed and the cutter is far enough from
+ * both edges for the travel of the experiments
+ */
+bool tuning_is_allowed(void);
+
+/**
+ * @brief Handles the PID auto-tuning mode
+ * @details Runs the relay experiment on the selected axis:
+ * 1. Axis is selected by Right / Left buttons, F2 starts
+ * 2. Breakaway duty is measured in both directions and compensated
+ * 3. Velocity loop is tuned and its gains are applied for the next experiment
+ * 4. Position loop is tuned
+ * 5. Gains of both loops are shown, F2 applies them. With
+ *    FEEDER_GAIN_SCHEDULE gains of the feeder are added to its schedule
+ *    for the inertia of the mounted roll.
+ *    F1 rejects them and restores the gains from before the tuning.
+ * 6. Ultimate gains and periods are shown, F1 returns to manual mode
+ * Backlash of the feeder is measured on a printed mark under the sensor:
+ * 1. "Vola: Feeder" is selected by Right / Left buttons, F2 starts
+ * 2. Paper is fed forward and backward over the mark at scan speed
+ * 3. Difference of the two mark positions is compensated and shown
+ */
+void handle_tuning_state(void);
+
+#endif // MACHINE_TUNING_MODE_H
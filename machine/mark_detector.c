@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/adc.h"
 #include "mark_detector.h"
@@ -8,7 +9,6 @@
 #define WINDOW_SIZE 10
 #define BELLOW_AVG_MIN 80
 #define VOID_REFLECTIVITY_THRESHOLD 120
-#define INITIAL_MINIMUM_VALUE 0x1000   // 4096 in hex
 #define MIN_SPIKE_AREA 4000           // Minimum valid area
 #define MAX_SPIKE_AREA 20000          // Maximum valid area
 
@@ -19,15 +19,30 @@ typedef struct {
     bool buffer_full;
 } moving_average_filter_t;
 
+// Samples of the history which can still become its minimum, values rise from
+// the oldest to the newest. Of equal values only the newest one is kept.
 typedef struct {
+    uint16_t value[MEM_SIZE];
+    uint32_t sample[MEM_SIZE];    // Sample number, see detector_t
+    uint16_t first;
+    uint16_t count;
+} minimum_deque_t;
+
+typedef struct {
+    // Ring buffers, the newest sample is at head and older ones follow it
     uint16_t reflectivity_history[MEM_SIZE];
+    uint32_t position_history[MEM_SIZE];    // Feeder position in encoder counts, plus position_shift
+    uint16_t head;
+    uint32_t sample_number;       // Number of the newest sample, wraps around
+    minimum_deque_t minimum;
     uint16_t samples;
     int16_t start_of_spike, end_of_spike;
     bool sampling_done;
-    float position_history[MEM_SIZE];
     float mark_position;
     float edge_position;
     float *feeder_position;
+    float counts_per_unit;        // Encoder counts in one unit of the feeder position
+    uint32_t position_shift;      // Counts the origin moved by, wraps around
     bool *error;
     char (*error_message)[21];
     moving_average_filter_t reflectivity_filter;
@@ -65,21 +80,53 @@ uint16_t moving_average_compute(moving_average_filter_t* filter, uint16_t new_va
     return (uint16_t)(filter->sum / divisor);
 }
 
+static void minimum_push(minimum_deque_t* deque, uint16_t value, uint32_t sample) {
+    // Older samples which are not lower never become the minimum again
+    while (deque->count > 0) {
+        uint16_t last = deque->first + deque->count - 1;
+        last = last >= MEM_SIZE ? last - MEM_SIZE : last;
+        if (deque->value[last] < value) {
+            break;
+        }
+        deque->count--;
+    }
+    uint16_t index = deque->first + deque->count;
+    index = index >= MEM_SIZE ? index - MEM_SIZE : index;
+    deque->value[index] = value;
+    deque->sample[index] = sample;
+    deque->count++;
+}
+
+static void minimum_drop(minimum_deque_t* deque, uint32_t sample) {
+    if (deque->count > 0 && deque->sample[deque->first] == sample) {
+        deque->first = deque->first + 1 >= MEM_SIZE ? 0 : deque->first + 1;
+        deque->count--;
+    }
+}
+
+// Ring index of the sample taken age samples ago
+static inline uint16_t history_index(uint16_t age) {
+    uint16_t index = detector.head + age;
+    return index >= MEM_SIZE ? index - MEM_SIZE : index;
+}
+
+static inline uint16_t reflectivity_at(uint16_t age) {
+    return detector.reflectivity_history[history_index(age)];
+}
+
+static float position_at(uint16_t age) {
+    const int32_t counts = (int32_t)(detector.position_history[history_index(age)] - detector.position_shift);
+    return (float)counts / detector.counts_per_unit;
+}
+
 bool is_spike_at_boundaries(uint16_t tolerance_line) {
-    return (detector.reflectivity_history[0] < tolerance_line) || 
-           (detector.reflectivity_history[MEM_SIZE - 1] < tolerance_line);
+    return (reflectivity_at(0) < tolerance_line) || 
+           (reflectivity_at(MEM_SIZE - 1) < tolerance_line);
 }
 
+// Minimum of the history, the newest one of equal values
 void find_min(uint16_t *index_of_minimum) {
-    uint16_t minimum = INITIAL_MINIMUM_VALUE;    // init minimum far above the possible value 
-
-    // Find the minimum and maximum value in a given range of data
-    for (uint16_t i = 0; i < MEM_SIZE; i++) {
-        if (detector.reflectivity_history[i] < minimum) {
-            minimum = detector.reflectivity_history[i];
-            *index_of_minimum = i;
-        }
-    }
+    *index_of_minimum = (uint16_t)(detector.sample_number - detector.minimum.sample[detector.minimum.first]);
 }
 
 static void update_long_term_average(uint16_t new_value) {
@@ -93,13 +140,15 @@ static void update_long_term_average(uint16_t new_value) {
     }
 }
 
+// Sum of the differences of samples below the tolerance line. Scans the
+// whole history, detect_mark() calls it only for a minimum in the middle.
 static uint32_t calculate_spike_area(uint16_t tolerance_line) {
     uint32_t area = 0;
 
     // Sum the differences from tolerance line
     for (int i = 0; i < MEM_SIZE; i++) {
-        if (detector.reflectivity_history[i] < tolerance_line) {
-            area += (tolerance_line - detector.reflectivity_history[i]);
+        if (reflectivity_at(i) < tolerance_line) {
+            area += (tolerance_line - reflectivity_at(i));
         }
     }
 
@@ -108,6 +157,7 @@ static uint32_t calculate_spike_area(uint16_t tolerance_line) {
 
 void init_detector(const uint8_t sensor_pin, 
                   float* const feeder_pos,
+                  const float position_resolution,
                   bool* const detector_error, 
                   char (* const error_mes)[21]) {
     // Set gpio pin as ADC
@@ -117,11 +167,22 @@ void init_detector(const uint8_t sensor_pin,
     adc_gpio_init(sensor_pin + 26);
     adc_select_input(sensor_pin);
 
+    // History starts filled with zeros, the newest of them is the minimum
+    memset(detector.reflectivity_history, 0, sizeof(detector.reflectivity_history));
+    detector.sample_number = 0;
+    detector.minimum.first = 0;
+    detector.minimum.count = 0;
+    minimum_push(&detector.minimum, 0, detector.sample_number);
+
     // Initialize array
     detector.samples = 0;
     detector.sampling_done = false;
 
+    detector.head = 0;
+
     detector.feeder_position = feeder_pos;
+    detector.counts_per_unit = 1.0f / position_resolution;
+    detector.position_shift = 0;
 
     // Error handling
     detector.error = detector_error;
@@ -138,13 +199,16 @@ void init_detector(const uint8_t sensor_pin,
 void detector_compute() {
     uint16_t new_value = adc_read();
 
-    // Shift sensor readings using memmove
-    memmove(&detector.reflectivity_history[1], &detector.reflectivity_history[0], (MEM_SIZE - 1) * sizeof(uint16_t));
-    detector.reflectivity_history[0] = moving_average_compute(&detector.reflectivity_filter, new_value);
+    // The oldest sample is overwritten by the newest one, head moves back
+    detector.head = detector.head == 0 ? MEM_SIZE - 1 : detector.head - 1;
+    const uint16_t newest = moving_average_compute(&detector.reflectivity_filter, new_value);
+    detector.reflectivity_history[detector.head] = newest;
 
-    // Shift position readings using memmove
-    memmove(&detector.position_history[1], &detector.position_history[0], (MEM_SIZE - 1) * sizeof(float));
-    detector.position_history[0] = *detector.feeder_position;
+    detector.sample_number++;
+    minimum_drop(&detector.minimum, detector.sample_number - MEM_SIZE);
+    minimum_push(&detector.minimum, newest, detector.sample_number);
+    detector.position_history[detector.head] =
+        (uint32_t)lroundf(*detector.feeder_position * detector.counts_per_unit) + detector.position_shift;
 
     update_long_term_average(new_value);
 
@@ -177,7 +241,7 @@ bool detect_mark() {
     }
 
     // Verify that the spike has the minimum depth
-    if (detector.reflectivity_history[index_of_minimum] > detector.long_term_average - BELLOW_AVG_MIN) {
+    if (reflectivity_at(index_of_minimum) > detector.long_term_average - BELLOW_AVG_MIN) {
         return false;
     }
     
@@ -194,22 +258,41 @@ bool detect_mark() {
     }
 
     // Everything is valid, mark the position
-    detector.mark_position = detector.position_history[index_of_minimum];
+    detector.mark_position = position_at(index_of_minimum);
     return true;
 }
 
 bool get_void_presence() {
-    return detector.reflectivity_history[0] < VOID_REFLECTIVITY_THRESHOLD;
+    return reflectivity_at(0) < VOID_REFLECTIVITY_THRESHOLD;
 }
 
 bool get_void_absence() {
-    return detector.reflectivity_history[0] > VOID_REFLECTIVITY_THRESHOLD;
+    return reflectivity_at(0) > VOID_REFLECTIVITY_THRESHOLD;
+}
+
+void detector_shift_positions(const float offset) {
+    // Stored counts stay, the shift is subtracted when they are read
+    detector.position_shift += (uint32_t)lroundf(offset * detector.counts_per_unit);
+    detector.mark_position -= offset;
+    detector.edge_position -= offset;
+}
+
+float detector_get_delay(void) {
+    // Moving average is centered in the middle of its window
+    return (WINDOW_SIZE - 1) / 2.0f;
 }
 
 float get_mark_position(void) {
     return detector.mark_position;
 }
 
-const uint16_t* get_reflectivity_history(void) {
-    return detector.reflectivity_history;
+reflectivity_view_t get_reflectivity_history(void) {
+    const uint16_t head = detector.head;
+    const reflectivity_view_t view = {
+        .newest = &detector.reflectivity_history[head],
+        .newest_length = MEM_SIZE - head,
+        .oldest = detector.reflectivity_history,
+        .oldest_length = head,
+    };
+    return view;
 }
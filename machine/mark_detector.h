@@ -9,6 +9,7 @@
  * 
  * @param sensor_pin ADC pin number (26-28) for the reflectivity sensor
  * @param feeder_position Pointer to the current feeder position value
+ * @param position_resolution Feeder travel of one encoder count, positions are stored in counts
  * @param detector_error Pointer to error flag for error state indication
  * @param error_message Pointer to error message array for detailed error reporting
  * 
@@ -17,13 +18,15 @@
  */
 void init_detector(const uint8_t sensor_pin, 
                   float* const feeder_position,
+                  const float position_resolution,
                   bool* const detector_error, 
                   char (* const error_message)[21]);
 
 /**
  * @brief Main processing function for the detector
  * 
- * Reads sensor data, updates moving averages and history buffers.
+ * Reads sensor data, updates moving averages, history buffers and the
+ * minimum of the history used by detect_mark().
  * Should be called periodically at a consistent rate for optimal detection.
  */
 void detector_compute(void);
@@ -67,9 +70,36 @@ bool is_sampling_done(void);
 float get_mark_position(void);
 
 /**
- * @brief Gets pointer to reflectivity history array
- * @return Pointer to array of MEM_SIZE (250) uint16_t values
+ * @brief Delay of the filtered reflectivity behind the position history
+ * @return Delay in samples, the mark position lies this many samples ahead
+ * in the direction of movement
  */
-const uint16_t* get_reflectivity_history(void);
+float detector_get_delay(void);
+
+/**
+ * @brief Shifts all stored positions when the feeder origin moves
+ * @param offset Distance the origin moved, subtracted from the positions
+ */
+void detector_shift_positions(const float offset);
+
+/**
+ * @brief Reflectivity history without a copy, two spans of the ring buffer.
+ * Both spans run from newer to older samples, the oldest span follows the newest one.
+ */
+typedef struct {
+    const uint16_t* newest;
+    uint16_t newest_length;
+    const uint16_t* oldest;
+    uint16_t oldest_length;
+} reflectivity_view_t;
+
+/**
+ * @brief Gets a view of the reflectivity history, MEM_SIZE (250) samples in total
+ *
+ * Every sample overwrites the oldest one, a reader on the other core has
+ * the time of the samples it does not read before its data change.
+ * @return Spans of the history ring buffer
+ */
+reflectivity_view_t get_reflectivity_history(void);
 
 #endif
\ No newline at end of file
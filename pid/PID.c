@@ -5,22 +5,38 @@ static const float PID_OUT_MIN = -1024.0f;
 static const float PID_OUT_MAX = 1024.0f;
 static const float PID_ITERM_MIN = -1024.0f;
 static const float PID_ITERM_MAX = 1024.0f;
+static const float PID_TRACKING = 0.5f;			// Default back-calculation gain
+static const uint32_t PID_FAULT_CYCLES = 500;	// Default saturated computes before a fault
 
 struct pid_data {
 	// Input, output and setpoint
-	float * input; 		// Current Process Value
-	float * output; 	// Corrective Output from PID Controller
-	float * setpoint; 	// Controller Setpoint
+	float * input;			// Current Process Value
+	float * output;			// Corrective Output from PID Controller
+	float * setpoint;		// Controller Setpoint
 	
 	// Tuning parameters
-	float Kp; 			// Stores the gain for the Proportional term
-	float Ki; 			// Stores the gain for the Integral term
-	float Kd;			// Stores the gain for the Derivative term
+	float Kp;				// Stores the gain for the Proportional term
+	float Ki;				// Stores the gain for the Integral term
+	float Kd;				// Stores the gain for the Derivative term
+	float Kt;				// Back-calculation gain, part of the saturation excess removed from iterm
+	float beta;				// Setpoint weight of the proportional term
+	float alpha;			// Derivative filter coefficient, 1 is unfiltered
 
-	float iterm; 		// Accumulator for integral term
-	float lastin; 		// Last input value for differential term
-	
-	bool error; 		// Error flag
+	// Output limits
+	float out_min;
+	float out_max;
+
+	float iterm;			// Accumulator for integral term
+	float lastin;			// Last input value for differential term
+	float lastset;			// Last setpoint, for bumpless changes of setpoint weight
+	float dfilter;			// Filtered change of input
+	bool running;			// Computed since the last reset, output is kept on changes
+
+	// Diagnostics
+	bool saturated;			// Output was limited in the last compute
+	uint32_t saturated_cycles;	// Consecutive computes with limited output
+	uint32_t fault_cycles;	// Saturated computes which make a fault
+	bool error;				// Fault flag, stays set until reset
 };
 
 pid_data_t* pid_create(float* in, float* out, float* set, float kp, float ki, float kd)
@@ -35,55 +51,169 @@ pid_data_t* pid_create(float* in, float* out, float* set, float kp, float ki, fl
 	pid->Kp = kp;
 	pid->Ki = ki;
 	pid->Kd = kd;
+	pid->Kt = PID_TRACKING;
+	pid->beta = 1.0f;
+	pid->alpha = 1.0f;
+	pid->out_min = PID_OUT_MIN;
+	pid->out_max = PID_OUT_MAX;
+	pid->fault_cycles = PID_FAULT_CYCLES;
 		
 	return pid;
 }
 
+/**
+ * Proportional error with weighted setpoint
+ */
+static float pid_weighted_error(const pid_data_t* const pid, const float set, const float in) {
+	return pid->beta * set - in;
+}
+
+/**
+ * Moves the integral term by the change of the other terms, so the output stays the same
+ */
+static void pid_bumpless(pid_data_t* const pid, const float change) {
+	if (!pid->running) {
+		return;
+	}
+	float iterm = pid->iterm + change;
+	if (iterm > PID_ITERM_MAX) {
+		iterm = PID_ITERM_MAX;
+	} else if (iterm < PID_ITERM_MIN) {
+		iterm = PID_ITERM_MIN;
+	}
+	pid->iterm = iterm;
+}
+
 void pid_compute(pid_data_t* const pid)
 {
 	float in = *(pid->input);
+	float set = *(pid->setpoint);
 	// Compute error
-	float error = (*(pid->setpoint)) - in;
+	float error = set - in;
 
 	// Compute integral
-	pid->iterm += (pid->Ki * error);
-
-	// Apply limit to integral value
-	if (pid->iterm > PID_ITERM_MAX) {
-		pid->iterm = PID_ITERM_MAX;
-		pid->error = true;
-	} else if (pid->iterm < PID_ITERM_MIN) {
-		pid->iterm = PID_ITERM_MIN;
-		pid->error = true;
-	}
+	float iterm = pid->iterm + pid->Ki * error;
 
-	// Compute differential on input
-	float dinput = in - pid->lastin;
+	// Compute filtered differential on input
+	pid->dfilter += pid->alpha * (in - pid->lastin - pid->dfilter);
 
 	// Compute PID output
-	float out = pid->Kp * error + pid->iterm - pid->Kd * dinput;
+	float out = pid->Kp * pid_weighted_error(pid, set, in) + iterm - pid->Kd * pid->dfilter;
 
 	// Apply limit to output value
-	if (out > PID_OUT_MAX) {
-		out = PID_OUT_MAX;
-	} else if (out < PID_OUT_MIN) {
-		out = PID_OUT_MIN;
+	float limited = out;
+	if (out > pid->out_max) {
+		limited = pid->out_max;
+	} else if (out < pid->out_min) {
+		limited = pid->out_min;
+	}
+
+	// Back-calculation, integral is pulled back by the part of output cut off by the limit
+	iterm += pid->Kt * (limited - out);
+
+	// Apply limit to integral value
+	if (iterm > PID_ITERM_MAX) {
+		iterm = PID_ITERM_MAX;
+	} else if (iterm < PID_ITERM_MIN) {
+		iterm = PID_ITERM_MIN;
+	}
+	pid->iterm = iterm;
+
+	// Short saturation is normal during hard acceleration, only a lasting one is a fault
+	pid->saturated = limited != out;
+	if (!pid->saturated) {
+		pid->saturated_cycles = 0;
+	} else if (++pid->saturated_cycles >= pid->fault_cycles) {
+		pid->error = true;
 	}
 	
 	// Output to pointed variable
-	(*pid->output) = out;
+	(*pid->output) = limited;
 
 	// Keep track of some variables for next execution
 	pid->lastin = in;
+	pid->lastset = set;
+	pid->running = true;
+}
+
+void pid_set_tunings(pid_data_t* const pid, float kp, float ki, float kd) {
+	// Integral is accumulated with Ki already applied, only P and D terms jump
+	pid_bumpless(pid, (pid->Kp - kp) * pid_weighted_error(pid, pid->lastset, pid->lastin)
+		- (pid->Kd - kd) * pid->dfilter);
+	pid->Kp = kp;
+	pid->Ki = ki;
+	pid->Kd = kd;
+}
+
+void pid_get_tunings(const pid_data_t* const pid, float* const kp, float* const ki, float* const kd) {
+	*kp = pid->Kp;
+	*ki = pid->Ki;
+	*kd = pid->Kd;
+}
+
+void pid_schedule(const pid_gain_set_t sets[], const uint8_t count, const float x,
+				float* const kp, float* const ki, float* const kd) {
+	// Last set at or below x, the first one when x is below all of them
+	uint8_t i = 0;
+	while (i + 1 < count && sets[i + 1].x <= x) {
+		i++;
+	}
+	const pid_gain_set_t* low = &sets[i];
+	const pid_gain_set_t* high = &sets[i + 1 < count ? i + 1 : i];
+
+	float weight = 0.0f;
+	if (high->x > low->x && x > low->x) {
+		weight = (x - low->x) / (high->x - low->x);
+	}
+	*kp = low->kp + weight * (high->kp - low->kp);
+	*ki = low->ki + weight * (high->ki - low->ki);
+	*kd = low->kd + weight * (high->kd - low->kd);
+}
+
+void pid_set_setpoint_weight(pid_data_t* const pid, float beta) {
+	const float old_error = pid_weighted_error(pid, pid->lastset, pid->lastin);
+	pid->beta = beta;
+	pid_bumpless(pid, pid->Kp * (old_error - pid_weighted_error(pid, pid->lastset, pid->lastin)));
+}
+
+void pid_set_derivative_filter(pid_data_t* const pid, float cycles) {
+	pid->alpha = 1.0f / (1.0f + cycles);
+}
+
+void pid_set_antiwindup(pid_data_t* const pid, float kt) {
+	pid->Kt = kt;
+}
+
+void pid_set_output_limits(pid_data_t* const pid, float min, float max) {
+	pid->out_min = min;
+	pid->out_max = max;
+}
+
+void pid_set_fault_time(pid_data_t* const pid, uint32_t cycles) {
+	pid->fault_cycles = cycles;
+}
+
+void pid_shift(pid_data_t* const pid, float offset) {
+	pid->lastin -= offset;
+	pid->lastset -= offset;
 }
 
 void pid_reset_all(pid_data_t* const pid) {
-	pid->iterm = 0.0;
-	*pid->output = 0.0;
+	pid->iterm = 0.0f;
+	*pid->output = 0.0f;
 	pid->lastin = *(pid->input);
+	pid->lastset = *(pid->setpoint);
+	pid->dfilter = 0.0f;
+	pid->saturated = false;
+	pid->saturated_cycles = 0;
+	pid->running = false;
 	pid->error = false;
 }
 
+bool pid_get_saturated(const pid_data_t* const pid) {
+	return pid->saturated;
+}
+
 bool pid_get_error(const pid_data_t* const pid) {
 	return pid->error;
-}
\ No newline at end of file
+}
@@ -6,6 +6,17 @@
 
 typedef struct pid_data pid_data_t;
 
+/**
+ * Gains tuned for one value of a scheduling variable, for example the
+ * inertia of the load. Sets are kept sorted by the variable.
+ */
+typedef struct {
+	float x;		// Value of the scheduling variable the gains are tuned for
+	float kp;
+	float ki;
+	float kd;
+} pid_gain_set_t;
+
 /**
  * @brief Creates a new PID controller
  *
@@ -13,9 +24,9 @@ typedef struct pid_data pid_data_t;
  * variables. Also we set the tuning parameters
  *
  * @param pid A pointer to a pid_controller structure
- * @param in Pointer to float value for the process input
+ * @param in Pointer to the process input value
  * @param out Poiter to put the controller output value
- * @param set Pointer float with the process setpoint value
+ * @param set Pointer to the process setpoint value
  * @param kp Proportional gain
  * @param ki Integral gain
  * @param kd Diferential gain
@@ -36,8 +47,116 @@ pid_data_t* pid_create(float* in, float* out, float* set, float kp, float ki, fl
  */
 void pid_compute(pid_data_t* const pid);
 
+/**
+ * @brief Changes the tuning parameters at runtime
+ *
+ * The integral term is adjusted so the output does not jump.
+ *
+ * @param pid The PID controller instance
+ * @param kp Proportional gain
+ * @param ki Integral gain
+ * @param kd Diferential gain
+ */
+void pid_set_tunings(pid_data_t* const pid, float kp, float ki, float kd);
+
+/**
+ * @brief Reads the tuning parameters
+ *
+ * @param pid The PID controller instance
+ * @param kp Proportional gain
+ * @param ki Integral gain
+ * @param kd Diferential gain
+ */
+void pid_get_tunings(const pid_data_t* const pid, float* const kp, float* const ki, float* const kd);
+
+/**
+ * @brief Interpolates gains between the two sets around x
+ *
+ * Gains are linear in x between neighbouring sets, outside of the range
+ * the nearest set is taken.
+ *
+ * @param sets Gain sets sorted by x
+ * @param count Number of sets, at least 1
+ * @param x Current value of the scheduling variable
+ * @param kp Interpolated proportional gain
+ * @param ki Interpolated integral gain
+ * @param kd Interpolated diferential gain
+ */
+void pid_schedule(const pid_gain_set_t sets[], const uint8_t count, const float x,
+				float* const kp, float* const ki, float* const kd);
+
+/**
+ * @brief Sets the weight of the setpoint in the proportional term
+ *
+ * Proportional term acts on beta * setpoint - input, values below 1 reduce
+ * overshoot on setpoint steps. Integral term always acts on the full error.
+ *
+ * @param pid The PID controller instance
+ * @param beta Setpoint weight, 1 by default
+ */
+void pid_set_setpoint_weight(pid_data_t* const pid, float beta);
+
+/**
+ * @brief Sets the first-order filter of the derivative term
+ *
+ * @param pid The PID controller instance
+ * @param cycles Filter time constant in computes, 0 is unfiltered
+ */
+void pid_set_derivative_filter(pid_data_t* const pid, float cycles);
+
+/**
+ * @brief Sets the back-calculation gain of the anti-windup
+ *
+ * When the output is limited, kt times the cut off part is removed from
+ * the integral term in every compute.
+ *
+ * @param pid The PID controller instance
+ * @param kt Back-calculation gain between 0 and 1, 0.5 by default
+ */
+void pid_set_antiwindup(pid_data_t* const pid, float kt);
+
+/**
+ * @brief Sets the output limits, +-1024 by default
+ *
+ * @param pid The PID controller instance
+ * @param min Lower limit of the output
+ * @param max Upper limit of the output
+ */
+void pid_set_output_limits(pid_data_t* const pid, float min, float max);
+
+/**
+ * @brief Sets how long the output may stay saturated before a fault
+ *
+ * @param pid The PID controller instance
+ * @param cycles Consecutive saturated computes which raise the fault, 500 by default
+ */
+void pid_set_fault_time(pid_data_t* const pid, uint32_t cycles);
+
+/**
+ * @brief Shifts the stored input and setpoint when both are moved to a new
+ * origin, so the derivative term does not see a step
+ *
+ * @param pid The PID controller instance
+ * @param offset Value subtracted from input and setpoint
+ */
+void pid_shift(pid_data_t* const pid, float offset);
+
 void pid_reset_all(pid_data_t* const pid);
 
+/**
+ * @brief Checks if the output was limited in the last compute
+ *
+ * @param pid The PID controller instance
+ * @return true if the output is saturated
+ */
+bool pid_get_saturated(const pid_data_t* const pid);
+
+/**
+ * @brief Checks if the output stayed saturated for the fault time
+ *
+ * @param pid The PID controller instance
+ * @return true if faulted, stays set until pid_reset_all
+ */
 bool pid_get_error(const pid_data_t* const pid);
 
 #endif
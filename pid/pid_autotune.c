@@ -0,0 +1,146 @@
+#include "pid_autotune.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define AUTOTUNE_SKIP_CYCLES 2		// First oscillations are not settled yet
+#define AUTOTUNE_MEASURE_CYCLES 4	// Oscillations averaged for the result
+#define AUTOTUNE_TIMEOUT 3000		// Maximum cycles of one relay half period
+
+struct pid_autotune {
+	autotune_state_t state;
+
+	// Relay
+	float setpoint;
+	float amplitude;
+	float hysteresis;
+	bool output_high;
+
+	// Oscillation measurement
+	float peak_max;			// Extremes of the current oscillation
+	float peak_min;
+	uint32_t ticks;			// Cycles since the start
+	uint32_t last_rise;		// Cycle of the last switch to high output
+	uint32_t last_switch;	// Cycle of the last switch
+	uint8_t oscillations;	// Full oscillations seen so far
+	float sum_amplitude;
+	float sum_period;
+
+	// Result
+	float ku;
+	float tu;
+};
+
+pid_autotune_t* autotune_create(void) {
+	pid_autotune_t* tune = calloc(1, sizeof(struct pid_autotune));
+	tune->state = AUTOTUNE_OFF;
+	return tune;
+}
+
+void autotune_start(pid_autotune_t* const tune, const float setpoint, const float amplitude, const float hysteresis) {
+	tune->state = AUTOTUNE_RUNNING;
+	tune->setpoint = setpoint;
+	tune->amplitude = amplitude;
+	tune->hysteresis = hysteresis;
+	tune->output_high = true;
+	tune->peak_max = -INFINITY;
+	tune->peak_min = INFINITY;
+	tune->ticks = 0;
+	tune->last_rise = 0;
+	tune->last_switch = 0;
+	tune->oscillations = 0;
+	tune->sum_amplitude = 0.0f;
+	tune->sum_period = 0.0f;
+	tune->ku = 0.0f;
+	tune->tu = 0.0f;
+}
+
+/**
+ * One full oscillation ends on every switch to high output. Its amplitude
+ * and period are accumulated once the transient has died out.
+ */
+void autotune_oscillation_end(pid_autotune_t* const tune) {
+	tune->oscillations++;
+	if (tune->oscillations > AUTOTUNE_SKIP_CYCLES) {
+		tune->sum_amplitude += (tune->peak_max - tune->peak_min) / 2.0f;
+		tune->sum_period += (float)(tune->ticks - tune->last_rise);
+	}
+	tune->last_rise = tune->ticks;
+	tune->peak_max = -INFINITY;
+	tune->peak_min = INFINITY;
+
+	if (tune->oscillations < AUTOTUNE_SKIP_CYCLES + AUTOTUNE_MEASURE_CYCLES) {
+		return;
+	}
+
+	// Relay with hysteresis, the oscillation amplitude is corrected by it
+	const float amplitude = tune->sum_amplitude / AUTOTUNE_MEASURE_CYCLES;
+	const float corrected = sqrtf(fmaxf(amplitude * amplitude - tune->hysteresis * tune->hysteresis, 0.0f));
+	if (corrected <= 0.0f) {
+		tune->state = AUTOTUNE_FAILED;
+		return;
+	}
+	tune->ku = 4.0f * tune->amplitude / ((float)M_PI * corrected);
+	tune->tu = tune->sum_period / AUTOTUNE_MEASURE_CYCLES;
+	tune->state = AUTOTUNE_FINISHED;
+}
+
+float autotune_compute(pid_autotune_t* const tune, const float input) {
+	if (tune->state != AUTOTUNE_RUNNING) {
+		return 0.0f;
+	}
+	tune->ticks++;
+
+	tune->peak_max = fmaxf(tune->peak_max, input);
+	tune->peak_min = fminf(tune->peak_min, input);
+
+	// Relay with hysteresis
+	const float error = tune->setpoint - input;
+	if (tune->output_high && error < -tune->hysteresis) {
+		tune->output_high = false;
+		tune->last_switch = tune->ticks;
+	} else if (!tune->output_high && error > tune->hysteresis) {
+		tune->output_high = true;
+		tune->last_switch = tune->ticks;
+		autotune_oscillation_end(tune);
+	}
+
+	// Process does not respond to the relay
+	if (tune->ticks - tune->last_switch > AUTOTUNE_TIMEOUT) {
+		tune->state = AUTOTUNE_FAILED;
+	}
+
+	if (tune->state != AUTOTUNE_RUNNING) {
+		return 0.0f;
+	}
+	return tune->output_high ? tune->amplitude : -tune->amplitude;
+}
+
+void autotune_abort(pid_autotune_t* const tune) {
+	if (tune->state == AUTOTUNE_RUNNING) {
+		tune->state = AUTOTUNE_FAILED;
+	}
+}
+
+autotune_state_t autotune_get_state(const pid_autotune_t* const tune) {
+	return tune->state;
+}
+
+float autotune_get_ku(const pid_autotune_t* const tune) {
+	return tune->ku;
+}
+
+float autotune_get_tu(const pid_autotune_t* const tune) {
+	return tune->tu;
+}
+
+void autotune_get_pi(const pid_autotune_t* const tune, float* const kp, float* const ki) {
+	// Kp = 0.45 Ku, Ti = Tu / 1.2, integral is summed every cycle
+	*kp = 0.45f * tune->ku;
+	*ki = *kp * 1.2f / tune->tu;
+}
+
+void autotune_get_pd(const pid_autotune_t* const tune, float* const kp, float* const kd) {
+	// Kp = 0.8 Ku, Td = Tu / 8, derivative is the difference of one cycle
+	*kp = 0.8f * tune->ku;
+	*kd = *kp * tune->tu / 8.0f;
+}
@@ -0,0 +1,77 @@
+#ifndef PID_AUTOTUNE_H
+#define PID_AUTOTUNE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Relay feedback experiment (Astrom-Hagglund). The process is driven by a
+ * relay with hysteresis, which makes it oscillate at its ultimate period.
+ * Ultimate gain and period are computed from the amplitude and the period of
+ * the oscillation, PID gains follow from Ziegler-Nichols rules.
+ */
+typedef struct pid_autotune pid_autotune_t;
+
+typedef enum {
+	AUTOTUNE_OFF,
+	AUTOTUNE_RUNNING,
+	AUTOTUNE_FINISHED,
+	AUTOTUNE_FAILED
+} autotune_state_t;
+
+/**
+ * @brief Creates a new relay tuner
+ * @return returns a pid_autotune_t* tuner handle
+ */
+pid_autotune_t* autotune_create(void);
+
+/**
+ * @brief Starts the relay experiment
+ *
+ * @param tune The tuner instance
+ * @param setpoint Process value the oscillation is centered on
+ * @param amplitude Relay output, the process is driven by +-amplitude
+ * @param hysteresis Relay switches when the error crosses +-hysteresis,
+ * should be above the noise of the process value
+ */
+void autotune_start(pid_autotune_t* const tune, const float setpoint, const float amplitude, const float hysteresis);
+
+/**
+ * @brief Computes the relay output, called once per control cycle
+ *
+ * @param tune The tuner instance
+ * @param input Current process value
+ *
+ * @return Relay output, zero when the experiment is not running
+ */
+float autotune_compute(pid_autotune_t* const tune, const float input);
+
+/**
+ * @brief Stops the experiment, the result is marked as failed
+ * @param tune The tuner instance
+ */
+void autotune_abort(pid_autotune_t* const tune);
+
+autotune_state_t autotune_get_state(const pid_autotune_t* const tune);
+
+/**
+ * @brief Ultimate gain 4d / (pi * a), valid when the experiment is finished
+ */
+float autotune_get_ku(const pid_autotune_t* const tune);
+
+/**
+ * @brief Ultimate period in control cycles, valid when the experiment is finished
+ */
+float autotune_get_tu(const pid_autotune_t* const tune);
+
+/**
+ * @brief Ziegler-Nichols PI gains in the per-cycle form used by pid_compute
+ */
+void autotune_get_pi(const pid_autotune_t* const tune, float* const kp, float* const ki);
+
+/**
+ * @brief Ziegler-Nichols PD gains in the per-cycle form used by pid_compute
+ */
+void autotune_get_pd(const pid_autotune_t* const tune, float* const kp, float* const kd);
+
+#endif
@@ -0,0 +1,122 @@
+#include "friction_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define FRICTION_MIN_COVERAGE 0.5f	// Part of the bins which has to be learned in each direction
+#define FRICTION_MIN_SAMPLES 10		// Bins with fewer samples are treated as not learned
+
+struct friction_map {
+	float start;
+	float bin_width;
+	uint16_t bins;
+	bool valid;
+
+	// Per direction, positive first
+	float* effort[2];		// Effort of the bin above the average of the range
+	float* sum[2];			// Samples while learning
+	uint16_t* count[2];
+};
+
+friction_map_t* friction_map_create(const float start, const float end, const uint16_t bins) {
+	friction_map_t* map = calloc(1, sizeof(struct friction_map));
+	map->start = fminf(start, end);
+	map->bin_width = fabsf(end - start) / (float)bins;
+	map->bins = bins;
+	for (int i = 0; i < 2; i++) {
+		map->effort[i] = calloc(bins, sizeof(float));
+		map->sum[i] = calloc(bins, sizeof(float));
+		map->count[i] = calloc(bins, sizeof(uint16_t));
+	}
+	map->valid = false;
+	return map;
+}
+
+void friction_map_learn_start(friction_map_t* const map) {
+	map->valid = false;
+	for (int i = 0; i < 2; i++) {
+		memset(map->sum[i], 0, map->bins * sizeof(float));
+		memset(map->count[i], 0, map->bins * sizeof(uint16_t));
+	}
+}
+
+void friction_map_learn(friction_map_t* const map, const float position, const float speed, const float effort) {
+	const float bin = floorf((position - map->start) / map->bin_width);
+	if (speed == 0.0f || bin < 0.0f || bin >= (float)map->bins) {
+		return;
+	}
+
+	const int direction = speed > 0.0f ? 0 : 1;
+	const uint16_t index = (uint16_t)bin;
+	if (map->count[direction][index] < UINT16_MAX) {
+		map->sum[direction][index] += effort;
+		map->count[direction][index]++;
+	}
+}
+
+/**
+ * Averages one direction and fills the gaps. Returns false when too few
+ * bins were learned, the effort of the direction is left untouched then.
+ * Average effort of the range depends on the speed, it is taken out and only
+ * the part which changes with position is kept.
+ */
+bool friction_map_finish_direction(friction_map_t* const map, const int direction) {
+	uint16_t learned = 0;
+	for (uint16_t i = 0; i < map->bins; i++) {
+		if (map->count[direction][i] >= FRICTION_MIN_SAMPLES) {
+			learned++;
+		}
+	}
+	if (learned < FRICTION_MIN_COVERAGE * map->bins) {
+		return false;
+	}
+
+	// Gaps take the last learned bin below, the ones at the start the first learned bin
+	float last = NAN;
+	for (uint16_t i = 0; i < map->bins; i++) {
+		if (map->count[direction][i] >= FRICTION_MIN_SAMPLES) {
+			last = map->sum[direction][i] / (float)map->count[direction][i];
+		}
+		map->effort[direction][i] = last;
+	}
+	float average = 0.0f;
+	for (int i = map->bins - 1; i >= 0; i--) {
+		if (isnan(map->effort[direction][i])) {
+			map->effort[direction][i] = last;
+		} else {
+			last = map->effort[direction][i];
+		}
+		average += map->effort[direction][i] / (float)map->bins;
+	}
+	for (uint16_t i = 0; i < map->bins; i++) {
+		map->effort[direction][i] -= average;
+	}
+	return true;
+}
+
+bool friction_map_learn_finish(friction_map_t* const map) {
+	map->valid = friction_map_finish_direction(map, 0) && friction_map_finish_direction(map, 1);
+	return map->valid;
+}
+
+bool friction_map_is_valid(const friction_map_t* const map) {
+	return map->valid;
+}
+
+float friction_map_get(const friction_map_t* const map, const float position, const float speed) {
+	if (!map->valid || speed == 0.0f) {
+		return 0.0f;
+	}
+
+	const float* effort = map->effort[speed > 0.0f ? 0 : 1];
+	float x = (position - map->start) / map->bin_width - 0.5f;
+	if (x <= 0.0f) {
+		return effort[0];
+	}
+	if (x >= (float)(map->bins - 1)) {
+		return effort[map->bins - 1];
+	}
+	const uint16_t index = (uint16_t)x;
+	const float weight = x - (float)index;
+	return effort[index] + weight * (effort[index + 1] - effort[index]);
+}
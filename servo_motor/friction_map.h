@@ -0,0 +1,68 @@
+#ifndef FRICTION_MAP_H
+#define FRICTION_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Drive effort needed to move an axis at constant speed, recorded per
+ * position bin and direction. The map is learned on a traverse of the axis
+ * and then fed forward, so the loops do not have to absorb friction which
+ * changes along the rail. Only the deviation from the average effort of the
+ * range is kept, the average changes with speed and is left to the loops.
+ */
+typedef struct friction_map friction_map_t;
+
+/**
+ * @brief Creates an empty map
+ *
+ * @param start Lower end of the mapped range
+ * @param end Upper end of the mapped range
+ * @param bins Number of position bins the range is split into
+ *
+ * @return returns a friction_map_t* map handle
+ */
+friction_map_t* friction_map_create(const float start, const float end, const uint16_t bins);
+
+/**
+ * @brief Clears the recorded effort and starts learning, the map is not
+ * valid until friction_map_learn_finish succeeds
+ * @param map The map instance
+ */
+void friction_map_learn_start(friction_map_t* const map);
+
+/**
+ * @brief Records one sample of the effort, called every cycle of constant speed
+ *
+ * @param map The map instance
+ * @param position Position of the axis, samples outside the range are dropped
+ * @param speed Speed of the axis, only its sign is used
+ * @param effort Drive effort at the position
+ */
+void friction_map_learn(friction_map_t* const map, const float position, const float speed, const float effort);
+
+/**
+ * @brief Averages the samples of every bin, bins without samples take the
+ * effort of the nearest learned bin
+ *
+ * @param map The map instance
+ *
+ * @return true and the map becomes valid when enough bins were learned in both directions
+ */
+bool friction_map_learn_finish(friction_map_t* const map);
+
+bool friction_map_is_valid(const friction_map_t* const map);
+
+/**
+ * @brief Effort at the position in the direction of the speed, interpolated
+ * between bin centers
+ *
+ * @param map The map instance
+ * @param position Position of the axis, clamped to the range
+ * @param speed Speed of the axis, only its sign is used
+ *
+ * @return Effort above the average, zero when the map is not valid or the speed is zero
+ */
+float friction_map_get(const friction_map_t* const map, const float position, const float speed);
+
+#endif
@@ -0,0 +1,206 @@
+#include "profile_cache.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define PROFILE_CACHE_BLOCK 256			// Samples in one block
+#define PROFILE_CACHE_ENTRIES 8			// Movements kept at most
+#define PROFILE_CACHE_SCALE 1048576.0f	// Fixed point units in one position unit
+#define PROFILE_CACHE_NONE 0xFFFF		// End of a chain of blocks
+
+typedef struct {
+	profile_key_t key;
+	profile_marks_t marks;
+	uint16_t first_block;
+	uint32_t last_used;		// Use counter when the entry was recorded or replayed
+	bool valid;
+} profile_entry_t;
+
+struct profile_cache {
+	int16_t (*samples)[PROFILE_CACHE_BLOCK];	// Change of step of every sample
+	uint16_t* next_block;		// Next block of the chain, links the free blocks too
+	uint16_t free_block;		// First free block
+	profile_entry_t entries[PROFILE_CACHE_ENTRIES];
+	uint32_t use_counter;
+
+	// Recording or replay in progress
+	profile_entry_t* recording;	// Entry being recorded, NULL when not recording
+	uint16_t block;				// Block of the last sample
+	uint32_t sample;			// Samples recorded or replayed
+	int32_t position;			// Fixed point position and step of the last sample
+	int32_t step;
+};
+
+profile_cache_t* profile_cache_create(const uint16_t blocks) {
+	profile_cache_t* cache = calloc(1, sizeof(struct profile_cache));
+	cache->samples = calloc(blocks, sizeof(*cache->samples));
+	cache->next_block = calloc(blocks, sizeof(uint16_t));
+
+	// All blocks start in the free chain
+	for (uint16_t i = 0; i < blocks; i++) {
+		cache->next_block[i] = i + 1 < blocks ? i + 1 : PROFILE_CACHE_NONE;
+	}
+	cache->free_block = blocks > 0 ? 0 : PROFILE_CACHE_NONE;
+	return cache;
+}
+
+/**
+ * Returns the blocks of the entry to the free chain and invalidates it
+ */
+void profile_cache_drop(profile_cache_t* const cache, profile_entry_t* const entry) {
+	uint16_t block = entry->first_block;
+	while (block != PROFILE_CACHE_NONE) {
+		const uint16_t next = cache->next_block[block];
+		cache->next_block[block] = cache->free_block;
+		cache->free_block = block;
+		block = next;
+	}
+	entry->first_block = PROFILE_CACHE_NONE;
+	entry->valid = false;
+}
+
+/**
+ * Least recently used stored movement, NULL when there is none
+ */
+profile_entry_t* profile_cache_oldest(profile_cache_t* const cache) {
+	profile_entry_t* oldest = NULL;
+	for (int i = 0; i < PROFILE_CACHE_ENTRIES; i++) {
+		profile_entry_t* entry = &cache->entries[i];
+		if (entry->valid && (oldest == NULL || entry->last_used < oldest->last_used)) {
+			oldest = entry;
+		}
+	}
+	return oldest;
+}
+
+/**
+ * Takes a free block, older movements are dropped until one is free
+ */
+uint16_t profile_cache_allocate(profile_cache_t* const cache) {
+	while (cache->free_block == PROFILE_CACHE_NONE) {
+		profile_entry_t* oldest = profile_cache_oldest(cache);
+		if (oldest == NULL) {
+			return PROFILE_CACHE_NONE;
+		}
+		profile_cache_drop(cache, oldest);
+	}
+
+	const uint16_t block = cache->free_block;
+	cache->free_block = cache->next_block[block];
+	cache->next_block[block] = PROFILE_CACHE_NONE;
+	return block;
+}
+
+void profile_cache_record_start(profile_cache_t* const cache, const profile_key_t* const key) {
+	profile_cache_record_abort(cache);
+
+	// Free entry, otherwise the least recently used one
+	profile_entry_t* entry = NULL;
+	for (int i = 0; i < PROFILE_CACHE_ENTRIES && entry == NULL; i++) {
+		if (!cache->entries[i].valid) {
+			entry = &cache->entries[i];
+		}
+	}
+	if (entry == NULL) {
+		entry = profile_cache_oldest(cache);
+		profile_cache_drop(cache, entry);
+	}
+
+	entry->key = *key;
+	entry->first_block = PROFILE_CACHE_NONE;
+	cache->recording = entry;
+	cache->block = PROFILE_CACHE_NONE;
+	cache->sample = 0;
+	cache->position = 0;
+	cache->step = 0;
+}
+
+bool profile_cache_record(profile_cache_t* const cache, const float position) {
+	if (cache->recording == NULL) {
+		return false;
+	}
+
+	// Step to the rounded position, rounding of the steps does not add up
+	const int32_t new_step = (int32_t)lroundf(position * PROFILE_CACHE_SCALE) - cache->position;
+	const int32_t change = new_step - cache->step;
+	if (change > INT16_MAX || change < INT16_MIN) {
+		profile_cache_record_abort(cache);
+		return false;
+	}
+
+	// First sample of a block, chain a new one
+	const uint32_t index = cache->sample % PROFILE_CACHE_BLOCK;
+	if (index == 0) {
+		const uint16_t block = profile_cache_allocate(cache);
+		if (block == PROFILE_CACHE_NONE) {
+			profile_cache_record_abort(cache);
+			return false;
+		}
+		if (cache->recording->first_block == PROFILE_CACHE_NONE) {
+			cache->recording->first_block = block;
+		} else {
+			cache->next_block[cache->block] = block;
+		}
+		cache->block = block;
+	}
+
+	cache->samples[cache->block][index] = (int16_t)change;
+	cache->step = new_step;
+	cache->position += new_step;
+	cache->sample++;
+	return true;
+}
+
+void profile_cache_record_finish(profile_cache_t* const cache, const profile_marks_t* const marks) {
+	profile_entry_t* entry = cache->recording;
+	if (entry == NULL) {
+		return;
+	}
+	entry->marks = *marks;
+	entry->marks.length = cache->sample;
+	entry->last_used = ++cache->use_counter;
+	entry->valid = true;
+	cache->recording = NULL;
+}
+
+void profile_cache_record_abort(profile_cache_t* const cache) {
+	if (cache->recording != NULL) {
+		profile_cache_drop(cache, cache->recording);
+		cache->recording = NULL;
+	}
+}
+
+bool profile_cache_replay_start(profile_cache_t* const cache, const profile_key_t* const key, profile_marks_t* const marks) {
+	profile_cache_record_abort(cache);
+
+	for (int i = 0; i < PROFILE_CACHE_ENTRIES; i++) {
+		profile_entry_t* entry = &cache->entries[i];
+		if (entry->valid && entry->key.start == key->start && entry->key.end == key->end &&
+			entry->key.speed == key->speed && entry->key.acc == key->acc &&
+			entry->key.jerk == key->jerk && entry->key.profile == key->profile) {
+			entry->last_used = ++cache->use_counter;
+			*marks = entry->marks;
+			cache->block = entry->first_block;
+			cache->sample = 0;
+			cache->position = 0;
+			cache->step = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+void profile_cache_replay_next(profile_cache_t* const cache, float* const position, float* const step, float* const step_change) {
+	const uint32_t index = cache->sample % PROFILE_CACHE_BLOCK;
+	if (index == 0 && cache->sample > 0) {
+		cache->block = cache->next_block[cache->block];
+	}
+
+	const int32_t change = cache->samples[cache->block][index];
+	cache->step += change;
+	cache->position += cache->step;
+	cache->sample++;
+
+	*position = (float)cache->position / PROFILE_CACHE_SCALE;
+	*step = (float)cache->step / PROFILE_CACHE_SCALE;
+	*step_change = (float)change / PROFILE_CACHE_SCALE;
+}
@@ -0,0 +1,102 @@
+#ifndef PROFILE_CACHE_H
+#define PROFILE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Setpoint sequences of movements which were already computed. The first
+ * run of a movement is recorded, identical movements later replay it at a
+ * constant cost per cycle. Changes of position are stored as differences
+ * in fixed point, 2^-20 of the position unit, and summed up on replay.
+ * Memory is a fixed pool of blocks, the least recently used movement is
+ * dropped when the pool is full.
+ */
+typedef struct profile_cache profile_cache_t;
+
+/**
+ * @brief Identifies a movement, all fields have to match for a replay
+ */
+typedef struct {
+	float start;		// Position where the movement starts from standstill
+	float end;			// Stop position
+	float speed;		// Speed limit
+	float acc;			// Acceleration limit
+	float jerk;			// Jerk limit
+	uint8_t profile;	// Shape of the profile
+} profile_key_t;
+
+/**
+ * @brief Samples where the phases of a recorded movement begin
+ */
+typedef struct {
+	uint32_t length;		// Samples of the movement
+	uint32_t speed_reached;	// First sample at the speed limit, UINT32_MAX if never reached
+	uint32_t braking;		// First sample of braking
+} profile_marks_t;
+
+/**
+ * @brief Creates an empty cache
+ *
+ * @param blocks Blocks of the pool, one block holds 256 samples in 512 bytes
+ *
+ * @return returns a profile_cache_t* cache handle
+ */
+profile_cache_t* profile_cache_create(const uint16_t blocks);
+
+/**
+ * @brief Starts recording a movement, an older recording of the cache is dropped
+ *
+ * @param cache The cache instance
+ * @param key Movement to be recorded
+ */
+void profile_cache_record_start(profile_cache_t* const cache, const profile_key_t* const key);
+
+/**
+ * @brief Records the next sample of the movement
+ *
+ * @param cache The cache instance
+ * @param position Position relative to the start, the replay lands on it
+ * within the rounding of the fixed point and does not drift
+ *
+ * @return false if the recording was aborted, the pool is full or the
+ * change of speed does not fit the encoding
+ */
+bool profile_cache_record(profile_cache_t* const cache, const float position);
+
+/**
+ * @brief Stores the recorded movement, it can be replayed from now on
+ *
+ * @param cache The cache instance
+ * @param marks Phases of the movement, length is taken from the recorded samples
+ */
+void profile_cache_record_finish(profile_cache_t* const cache, const profile_marks_t* const marks);
+
+/**
+ * @brief Drops the recording in progress
+ * @param cache The cache instance
+ */
+void profile_cache_record_abort(profile_cache_t* const cache);
+
+/**
+ * @brief Looks the movement up and starts its replay
+ *
+ * @param cache The cache instance
+ * @param key Movement to be replayed
+ * @param marks Phases of the recorded movement
+ *
+ * @return true if the movement is in the cache
+ */
+bool profile_cache_replay_start(profile_cache_t* const cache, const profile_key_t* const key, profile_marks_t* const marks);
+
+/**
+ * @brief Gets the next sample of the replayed movement
+ *
+ * @param cache The cache instance
+ * @param position Position relative to the start
+ * @param step Change of position since the previous sample
+ * @param step_change Change of step since the previous sample
+ */
+void profile_cache_replay_next(profile_cache_t* const cache, float* const position, float* const step, float* const step_change);
+
+#endif
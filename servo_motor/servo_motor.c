@@ -3,29 +3,177 @@
 #include "servo_motor.h"
 #include "../servo_motor/button.h"
 
-#define CYCLE_TIME 0.001
-#define FOLLOWING_ERROR 1.0 // Maximum permisible position deviation
+#define CYCLE_TIME 0.001f
+#define FOLLOWING_ERROR 1.0f // Permisible position deviation at standstill in rev
+#define FOLLOWING_ERROR_SPEED 0.02f	// Additional deviation per rev/s of profile speed
+#define FOLLOWING_ERROR_ACC 0.002f	// Additional deviation per rev/s^2 of profile acceleration
+#define FOLLOWING_ERROR_MOVES 8		// Movements kept in the record of following error peaks
+#define PHASE_CRUISE_ACC 0.01f		// Below this fraction of nominal acceleration the profile cruises
+#define SETTLE_WINDOW 0.0025f		// Default in-position window in rev, 10 tics
+#define SETTLE_SPEED 0.05f			// Default in-position speed threshold in rev/s
+#define SETTLE_TICKS 20				// Default cycles in the window before the servo is settled
+#define SETTLE_TIMEOUT 2000			// Cycles a finished movement may take to settle
+#define RETARGET_DEADBAND 0.00025f	// Retarget of a standing axis closer than one tic is ignored, in rev
+#define MOTION_QUEUE_SIZE 8
+#define TUNE_HYSTERESIS_VEL 0.05f	// Relay hysteresis of velocity loop tuning in rev/s
+#define TUNE_HYSTERESIS_POS 0.0005f	// Relay hysteresis of position loop tuning in rev, 2 tics
+#define OUTPUT_LIMIT 1024		// Limit of velocity setpoint and PWM output, same as PID output limit
+#define PWM_FREQUENCY 20000.0f	// Default PWM frequency in Hz, above the audible range
+#define PWM_RESOLUTION 1024		// Default PWM counter cycles in one period
+#define OUTPUT_DEADBAND 4		// Below this duty the breakaway compensation is ramped in from zero
+#define BREAKAWAY_COMPENSATION 0.9f	// Part of the measured breakaway duty compensated, all of it makes the axis hunt
+#define CALIB_RAMP 0.2f			// Duty added every cycle while searching for breakaway, 200 per second
+#define CALIB_MAX_DUTY 512.0f	// Calibration fails if the axis does not move below this duty
+#define CALIB_MOVE 0.002f		// Travel in rev which counts as breakaway, 8 tics
+#define CALIB_REST 300			// Cycles with zero output between the two directions
+#define BACKLASH_SPEED 2.0f		// Speed of taking up the backlash after a reversal in rev/s
+#define BACKLASH_ACC 100.0f		// Acceleration of taking up the backlash in rev/s^2
+#define FRICTION_FADE_SPEED 0.1f	// Friction feedforward is faded out below this commanded speed in rev/s
+#define FRICTION_LEARN_TOLERANCE 0.05f	// Effort is learned only while the speed is within this part of the command
+#define INERTIA_FILTER 10.0f	// Time constant of the speed and effort filters of inertia estimation in cycles
+#define INERTIA_MIN_ACC 0.2f	// Samples are taken above this part of the acceleration limit of the movement
+#define INERTIA_MIN_SAMPLES 50	// Movements with fewer samples do not update the estimate
+#define INERTIA_ADAPT 0.2f		// Part of the difference to the estimate of one movement taken over
+#define GAIN_SETS_MAX 4			// Gain sets of the schedule
+#define GAIN_SET_MERGE 0.1f		// Set within this part of the inertia of another one replaces it
+#define SATURATION_FAULT_TIME 500	// Cycles a loop may stay saturated before PID Error
+#define POS_DERIVATIVE_FILTER 1.0f	// Derivative filter time constant of position loop in cycles
+#define VEL_DERIVATIVE_FILTER 2.0f	// Derivative filter time constant of velocity loop in cycles
+#define ENCODER_SAMPLE_DIV 2500	// DMA timer runs at sysclk / 2500, 50kHz at 125MHz
+#define PERIOD_BLEND_LOW 8.0f	// Below this many tics per cycle only the edge period speed is used
+#define PERIOD_BLEND_HIGH 16.0f	// Above this many tics per cycle only the counted speed is used
+#define OBSERVER_BANDWIDTH 400.0f	// Default bandwidth of the state observer in rad/s
+#define THERMAL_TIME 30.0f			// Default thermal time constant of motor and driver in s
+#define THERMAL_RATED_DUTY 0.5f		// Default duty the drive can take continuously
+#define THERMAL_GOVERN_START 0.6f	// Movements are slowed down above this part of the thermal limit
+#define THERMAL_GOVERN_MIN 0.25f	// Lowest speed factor of movements, reached at THERMAL_FAULT
+#define THERMAL_FAULT 1.3f			// Part of the thermal limit which stops the machine
+
+typedef struct {
+	float position;			// Target position in servo units
+	float speed;			// Nominal speed in servo units
+	uint32_t dwell;			// Delay before the movement starts in ms
+	servo_event_t event;	// Called when the movement becomes active
+} motion_segment_t;
+
+static int encoder_dma_timer = -1;	// Paces sampling of all encoders
 
 struct servo_motor {
 	// Encoder
 	int sm;
 	int32_t enc_old;
+	int64_t enc_extended;		// Count extended over wraps of the 32-bit state machine count
+	int64_t enc_origin;			// Extended count at position zero, moved by servo_shift_origin
+	int enc_tx_dma;				// Requests the count from the state machine
+	int enc_rx_dma;				// Copies the count to enc_stream
+	volatile int32_t enc_stream;	// Count streamed by DMA
+	int32_t enc_count;			// Count latched at the start of the cycle
+
+	// Edge period measurement, same state machine number on pio1
+	float period_loops;			// Period program loops in one cycle
+	float period_speed;			// Tics per cycle from the last edge periods
+	uint32_t period_age;		// Cycles since the last edge
+	int8_t period_direction;	// Direction of the last counted tics
+
+	// State observer, runs in the loop of the velocity PID
+	state_observer_t* observer;
 
 	// PWM
+	int pwm_pin;
 	int pwm_slice;
+	int breakaway_pos;		// Duty which starts the motor in positive direction
+	int breakaway_neg;		// Duty which starts the motor in negative direction
+	volatile int output;	// Last controller duty, before the output map
+	volatile int duty;		// Last PWM duty, after the output map
+
+	// Thermal model, square of the duty filtered with the thermal time constant.
+	// Duty stands in for the current, 1 is full duty all the time.
+	float thermal;
+	float thermal_time;		// In s
+	float thermal_limit;	// Square of the rated duty
 	
 	// PID Position
 	pid_data_t* pid_pos;
 	float enc_position;
-	float out_pos;
 	float set_pos;
+	float out_pos;
 
 	// PID Velocity
 	pid_data_t* pid_vel;
-	float enc_speed;
+	float enc_speed;			// Observed speed in rev/s
+	float enc_acc;				// Observed acceleration in rev/s^2
 	float out_vel;
 	float set_vel;
 
+	// Feedforward
+	float kvff;				// Velocity feedforward gain, computed_speed to set_vel
+	float kaff;				// Acceleration feedforward gain, computed_acc to PWM
+	float following_error;	// set_pos - enc_position in user units
+
+	// Backlash compensation, in rev. Motor leads the load by half of the
+	// lash in the direction of the last commanded movement.
+	float backlash;
+	float backlash_offset;	// Motor position minus load position
+	float backlash_speed;	// Rate of change of the offset in rev/s
+	int8_t backlash_direction;
+
+	// Effort along the axis at constant speed, fed forward to PWM
+	friction_map_t* friction;
+	bool friction_learning;	// Effort is recorded, map is not applied
+
+	// Following error envelope and peaks per phase, in rev
+	float fe_static;
+	float fe_per_speed;
+	float fe_per_acc;
+	float fe_limit;			// Envelope of the last cycle
+	float fe_peaks[FOLLOWING_ERROR_MOVES][SERVO_PHASE_COUNT];
+	uint8_t fe_move;		// Record of the active movement
+
+	// In position detection, in rev and rev/s
+	float settle_window;
+	float settle_speed;
+	uint16_t settle_ticks;	// Consecutive cycles needed in the window
+	uint16_t settle_count;
+	uint16_t settle_wait;	// Cycles since the profile finished without settling
+	bool settle_armed;		// Last movement has not settled yet
+
+	float vel_kp;				// Velocity gains, applied by apply_velocity_gains
+	float vel_ki;
+	float vel_kd;
+
+	// Inertia estimation, effort against measured acceleration in accelerating phases.
+	// Inertia is in PWM per rev/s^2, 0 until the first estimate.
+	float inertia;
+	float est_speed;		// Filtered speed
+	float est_output;		// Filtered controller duty, same filter as the speed
+	float est_sum_a;		// Sums of acceleration and effort samples of the movement
+	float est_sum_u;
+	float est_sum_aa;
+	float est_sum_au;
+	uint16_t est_samples;
+
+	// Gain schedule over inertia, velocity gains per 1ms cycle
+	pid_gain_set_t pos_sets[GAIN_SETS_MAX];
+	pid_gain_set_t vel_sets[GAIN_SETS_MAX];
+	uint8_t gain_sets;
+	bool gain_store_pending;	// Current gains are stored with the next estimate
+
+	// Relay auto-tuning
+	pid_autotune_t* tuner;
+	servo_loop_t tune_loop;	// Loop driven by the relay
+	bool tuning;			// Experiment in progress, profile is not computed
+	float tune_start;		// Position at the start of the experiment
+	float tune_travel;		// Experiment is aborted beyond tune_start +- tune_travel
+
+	// Breakaway calibration, duty is ramped until the axis starts to move
+	bool calibrating;			// Calibration in progress, profile is not computed
+	autotune_state_t calib_state;
+	int8_t calib_direction;		// Positive direction runs first
+	float calib_duty;
+	float calib_start;			// Position where the ramp of the direction started
+	uint16_t calib_rest;		// Cycles left with zero output before the next ramp
+	int calib_result[2];		// Measured breakaway duty in positive and negative direction
+
 	// Error handling
 	bool *error; // Pointer to bool
 	char (*error_message)[21]; // Error message
@@ -52,14 +200,21 @@ struct servo_motor {
 	bool *enable;
 	bool enable_previous;
 	float computed_speed;
+	float computed_acc;
 	bool positive_direction;
 	bool set_zero;
 	bool nominal_speed_reached;
-	float enc_offset;
 
 	// Default movement
 	float nominal_speed; 	// Desired motor speed
 	float nominal_acc;		// Motor acceleration
+	float nominal_jerk;		// Motor jerk, used by S-curve profile
+	float move_acc;			// Commanded acceleration limit of the active movement
+	float move_jerk;		// Commanded jerk limit of the active movement
+	float run_speed;		// Speed of the active movement derated by the thermal governor
+	float run_acc;			// Acceleration of the active movement derated by the thermal governor
+	float run_jerk;			// Jerk of the active movement derated by the thermal governor
+	servo_profile_t profile;	// Shape of the motion profile
 	float current_speed; 	// Desired motor speed
 	float current_acc;		// Motor acceleration
 	float scale;			// Scale factor of the servo motor
@@ -67,10 +222,49 @@ struct servo_motor {
 	// Manual control
 	button_t *man_plus;
 	button_t *man_minus;
+
+	// Motion queue
+	motion_segment_t queue[MOTION_QUEUE_SIZE];
+	uint8_t queue_head;
+	uint8_t queue_count;
+	float end_speed;		// Speed at next_stop, non-zero when blending into next movement
+
+	// Braking plan of the S-curve profile, three segments of constant jerk.
+	// Speed and acceleration are magnitudes in the direction of movement.
+	bool brake_planned;
+	float brake_start;		// Position where braking started
+	float brake_stop;		// Stop position and end speed the plan leads to
+	float brake_end_speed;
+	float brake_time;		// Time since braking started in s
+	float brake_speed;		// Speed and acceleration when braking started
+	float brake_acc;
+	float brake_jerk;		// Jerk of the first segment, the second holds, the third releases
+	float brake_times[3];	// Durations of the segments in s
+
+	// Profile cache, movements from standstill to standstill are recorded once and replayed
+	profile_cache_t* cache;
+	enum cache_mode {
+		CACHE_OFF,				// Profile is computed
+		CACHE_RECORD,			// Profile is computed and recorded
+		CACHE_REPLAY			// Profile is replayed
+	} cache_mode;
+	float cache_start;			// Position the movement started from
+	float cache_target;			// Stop position of the cached movement
+	uint32_t cache_sample;		// Samples recorded or replayed
+	profile_marks_t cache_marks;
 };
 
-servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int sm, 
-                    const int encoder_pin, const int pwm_pin, const float scale,
+/**
+ * Velocity gains, derivative filter and fault time of the velocity PID
+ */
+void apply_velocity_gains(servo_t* const servo) {
+	pid_set_tunings(servo->pid_vel, servo->vel_kp, servo->vel_ki, servo->vel_kd);
+	pid_set_derivative_filter(servo->pid_vel, VEL_DERIVATIVE_FILTER);
+	pid_set_fault_time(servo->pid_vel, SATURATION_FAULT_TIME);
+}
+
+servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int period_ofset, const int sm, 
+                    const int encoder_pin, const int pwm_pin, const float scale, const float kvff, const float kaff,
                     button_t *const man_plus, button_t *const man_minus, 
                     bool *const enable, bool *const error, char (*const message)[21]) {
 	// Create servo data structure
@@ -81,21 +275,50 @@ servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int s
 	// Encoder
 	quadrature_encoder_program_init(pio0, sm, pio_ofset, encoder_pin, 0);
 	servo->sm = sm;
+
+	// Stream encoder count to RAM, all servos share the pacing timer
+	if (encoder_dma_timer < 0) {
+		encoder_dma_timer = dma_claim_unused_timer(true);
+		dma_timer_set_fraction(encoder_dma_timer, 1, ENCODER_SAMPLE_DIV);
+	}
+	servo->enc_tx_dma = dma_claim_unused_channel(true);
+	servo->enc_rx_dma = dma_claim_unused_channel(true);
+	quadrature_encoder_dma_init(pio0, sm, servo->enc_tx_dma, servo->enc_rx_dma, encoder_dma_timer, &servo->enc_stream);
 	servo->scale = scale;
 	servo->enc_old = 0;
+
+	// Edge period measurement on A phase
+	quadrature_period_program_init(pio1, sm, period_ofset, encoder_pin);
+	servo->period_loops = (float)clock_get_hz(clk_sys) * CYCLE_TIME / QUADRATURE_PERIOD_LOOP_CYCLES;
+	servo->observer = observer_create(CYCLE_TIME, OBSERVER_BANDWIDTH);
 			
 	// PWM
-	servo->pwm_slice = pwm_chan_init(pwm_pin);
+	servo->pwm_pin = pwm_pin;
+	servo->pwm_slice = pwm_chan_init(pwm_pin, PWM_FREQUENCY, PWM_RESOLUTION);
 
 	// PID
-	servo->pid_pos = pid_create(&servo->enc_position, &servo->out_pos, &servo->set_pos, 40.0, 0.0, 0.5);
-	servo->pid_vel = pid_create(&servo->enc_speed, &servo->out_vel, &servo->set_vel, 5.0, 3.0, 1.0);
+	servo->pid_pos = pid_create(&servo->enc_position, &servo->out_pos, &servo->set_pos, 40.0f, 0.0f, 0.5f);
+	servo->pid_vel = pid_create(&servo->enc_speed, &servo->out_vel, &servo->set_vel, 5.0f, 3.0f, 1.0f);
+	servo->vel_kp = 5.0f;
+	servo->vel_ki = 3.0f;
+	servo->vel_kd = 1.0f;
+	pid_set_derivative_filter(servo->pid_pos, POS_DERIVATIVE_FILTER);
+	pid_set_fault_time(servo->pid_pos, SATURATION_FAULT_TIME);
+	apply_velocity_gains(servo);
+
+	// Feedforward, acceleration gain is given per user unit
+	servo->kvff = kvff;
+	servo->kaff = kaff * scale;
+	servo->tuner = autotune_create();
 
 	// Positional controller
 	servo->nominal_acc = 100.0;
 	servo->nominal_speed = 30.0;
+	servo->nominal_jerk = 2000.0;
+	servo->profile = PROFILE_TRAPEZOIDAL;
 	servo->enc_old = 0;
 	servo->computed_speed = 0.0;
+	servo->computed_acc = 0.0;
 	servo->servo_speed = 0.0;
 
 	// Limits
@@ -103,7 +326,16 @@ servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int s
 	servo->error_message = message;
 	strcpy(*servo->error_message, "OK");
 	servo->pos_error_internal = false;
-	servo->enc_offset = 0.0;
+	servo->fe_static = FOLLOWING_ERROR;
+	servo->fe_per_speed = FOLLOWING_ERROR_SPEED;
+	servo->fe_per_acc = FOLLOWING_ERROR_ACC;
+	servo->settle_window = SETTLE_WINDOW;
+	servo->settle_speed = SETTLE_SPEED;
+	servo->settle_ticks = SETTLE_TICKS;
+	servo->thermal_time = THERMAL_TIME;
+	servo->thermal_limit = THERMAL_RATED_DUTY * THERMAL_RATED_DUTY;
+	servo->enc_extended = 0;
+	servo->enc_origin = 0;
 	servo->set_zero = false;
 
 	// Buttons 
@@ -113,7 +345,7 @@ servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int s
 	return servo;
 }
 
-float enc2speed(const int32_t enc_diff) {
+float enc2speed(const float enc_diff) {
 	// Time difference of measured encoder tics
 	// is ~1 milisecond but we want to get it in seconds,
 	// so we have to multiply by 1000
@@ -124,14 +356,460 @@ float enc2speed(const int32_t enc_diff) {
 	// (enc_diff * 1000.0) / 4000.0
 	
 	// return (float)enc_diff / 4.0;
-	return (float)enc_diff * (1.0 / CYCLE_TIME) / 4000.0;
+	return enc_diff * (1.0f / CYCLE_TIME / 4000.0f);
+}
+
+/**
+ * Speed from the time between rising edges of A phase, there is one edge
+ * every 4 tics. Returns tics per cycle, signed by the counted direction.
+ * The estimate is kept within one tic of the counted tics, so dithering on
+ * an edge at standstill can not produce a speed spike.
+ */
+float enc_period_speed(servo_t* const servo, const int32_t enc_diff) {
+	uint32_t loops = 0;
+	uint32_t edges = 0;
+	uint32_t period;
+	while (quadrature_period_fetch(pio1, servo->sm, &period)) {
+		if (period > 0) {
+			loops += period;
+			edges++;
+		}
+	}
+
+	// Period across a reversal is meaningless, start over
+	const int8_t direction = enc_diff > 0 ? 1 : (enc_diff < 0 ? -1 : servo->period_direction);
+	if (direction != servo->period_direction) {
+		servo->period_direction = direction;
+		servo->period_speed = 0.0f;
+		edges = 0;
+	}
+
+	if (edges > 0) {
+		servo->period_speed = 4.0f * (float)edges * servo->period_loops / (float)loops;
+		servo->period_age = 0;
+	} else {
+		// No edge, speed decays with the time since the last one
+		servo->period_age++;
+		const float limit = 4.0f / (float)servo->period_age;
+		if (servo->period_speed > limit) {
+			servo->period_speed = limit;
+		}
+	}
+
+	float speed = servo->period_speed;
+	const float counted = (float)abs(enc_diff);
+	if (speed > counted + 1.0f) {
+		speed = counted + 1.0f;
+	} else if (speed < counted - 1.0f) {
+		speed = counted - 1.0f;
+	}
+	return (float)direction * speed;
+}
+
+/**
+ * Blends counted and edge period speed. At low speed only few tics are
+ * counted in one cycle and the period gives much finer resolution.
+ * Returns tics per cycle.
+ */
+float enc_blended_speed(servo_t* const servo, const int32_t enc_diff) {
+	const float period_speed = enc_period_speed(servo, enc_diff);
+	const float counted = (float)abs(enc_diff);
+	float tics = (float)enc_diff;
+	if (counted <= PERIOD_BLEND_LOW) {
+		tics = period_speed;
+	} else if (counted < PERIOD_BLEND_HIGH) {
+		const float weight = (counted - PERIOD_BLEND_LOW) / (PERIOD_BLEND_HIGH - PERIOD_BLEND_LOW);
+		tics = weight * tics + (1.0f - weight) * period_speed;
+	}
+	return tics;
+}
+
+/**
+ * Integrates one constant-jerk segment of the profile.
+ * Updates speed and acceleration to the values at the end of the segment
+ * and returns the travelled distance.
+ */
+float integrate_segment(float* const speed, float* const acc, const float jerk, const float time) {
+	const float distance = *speed * time + *acc * time * time / 2.0f + jerk * time * time * time / 6.0f;
+	*speed += *acc * time + jerk * time * time / 2.0f;
+	*acc += jerk * time;
+	return distance;
+}
+
+/**
+ * Distance needed to slow down to the end speed from the current speed and
+ * acceleration when the deceleration has to be built up and released with
+ * limited jerk. Works with magnitudes, speed is positive in the direction
+ * of movement. Computed relative to the end speed, which adds end_speed * time.
+ */
+float get_jerk_limited_breaking_distance(float speed, float acc, const float acc_max, const float jerk, const float end_speed) {
+	float distance = 0.0f;
+	float time = 0.0f;
+	speed -= end_speed;
+
+	// Still accelerating, acceleration has to be released first
+	if (acc > 0.0f) {
+		time += acc / jerk;
+		distance += integrate_segment(&speed, &acc, -jerk, acc / jerk);
+		acc = 0.0f;
+	}
+
+	// Deceleration already present, releasing it alone takes all the remaining speed
+	const float dec = -acc;
+	if (speed <= dec * dec / (2.0f * jerk)) {
+		time += dec / jerk;
+		distance += integrate_segment(&speed, &acc, jerk, dec / jerk);
+		distance = distance > 0.0f ? distance : 0.0f;
+		return distance + end_speed * time;
+	}
+
+	// Peak deceleration of the triangular profile, limited by nominal acceleration
+	float dec_peak = sqrtf((2.0f * jerk * speed + dec * dec) / 2.0f);
+	float hold_time = 0.0f;
+	if (dec_peak > acc_max) {
+		dec_peak = acc_max > dec ? acc_max : dec;
+		hold_time = (speed - (2.0f * dec_peak * dec_peak - dec * dec) / (2.0f * jerk)) / dec_peak;
+		if (hold_time < 0.0f) {
+			hold_time = 0.0f;
+		}
+	}
+
+	time += (dec_peak - dec) / jerk + hold_time + dec_peak / jerk;
+	distance += integrate_segment(&speed, &acc, -jerk, (dec_peak - dec) / jerk);
+	distance += integrate_segment(&speed, &acc, 0.0f, hold_time);
+	distance += integrate_segment(&speed, &acc, jerk, dec_peak / jerk);
+	return distance + end_speed * time;
 }
 
 float get_breaking_distance(const servo_t* const servo) {
-	return 0.5 * (pow(servo->computed_speed, 2) / servo->current_acc);
+	if (servo->profile == PROFILE_S_CURVE) {
+		// Same sign convention as the trapezoidal distance below
+		const float direction = servo->positive_direction ? 1.0f : -1.0f;
+		return direction * get_jerk_limited_breaking_distance(servo->computed_speed * direction,
+			servo->computed_acc * direction, servo->run_acc, servo->run_jerk, servo->end_speed);
+	}
+	return 0.5f * ((servo->computed_speed * servo->computed_speed - servo->end_speed * servo->end_speed) / servo->current_acc);
+}
+
+/**
+ * Distance the axis travels in the next cycle with given speed and
+ * acceleration, plus the distance needed to slow down to the end speed afterwards.
+ */
+float s_curve_travel(const servo_t* const servo, const float speed, const float acc) {
+	if (speed <= servo->end_speed) {
+		return speed * CYCLE_TIME;
+	}
+	return speed * CYCLE_TIME + get_jerk_limited_breaking_distance(speed, acc,
+		servo->run_acc, servo->run_jerk, servo->end_speed);
+}
+
+/**
+ * Applies one cycle of jerk to speed and acceleration. Works with magnitudes
+ * in the direction of movement, speed is kept between 0 and the nominal speed.
+ */
+void s_curve_step(const servo_t* const servo, float* const speed, float* const acc, const float jerk) {
+	*acc += jerk * CYCLE_TIME;
+	if (*acc > servo->run_acc) {
+		*acc = servo->run_acc;
+	} else if (*acc < -servo->run_acc) {
+		*acc = -servo->run_acc;
+	}
+
+	*speed += *acc * CYCLE_TIME;
+	const float nominal_speed = fabsf(servo->current_speed);
+	if (*speed > nominal_speed) {
+		*speed = nominal_speed;
+		*acc = 0.0f;
+	} else if (*speed < 0.0f) {
+		*speed = 0.0f;
+		*acc = 0.0f;
+	}
+}
+
+/**
+ * One cycle of the S-curve acceleration phase. Acceleration is ramped up by
+ * the jerk limit and released early enough to land on the nominal speed.
+ * Returns true, without changing the state, when the step would leave
+ * too little distance for jerk-limited braking.
+ */
+bool s_curve_accelerate(servo_t* const servo) {
+	const float direction = servo->positive_direction ? 1.0f : -1.0f;
+	const float nominal_speed = fabsf(servo->current_speed);
+	float speed = servo->computed_speed * direction;
+	float acc = servo->computed_acc * direction;
+
+	// Ramp acceleration up only if it can still be released in time, speed gained
+	// while releasing it in discrete steps is a^2 / 2J - a * dt / 2
+	const float acc_up = acc + servo->run_jerk * CYCLE_TIME;
+	const float speed_up = speed + acc_up * CYCLE_TIME;
+	if (acc_up > 0.0f && speed_up + acc_up * (acc_up / (2.0f * servo->run_jerk) - CYCLE_TIME / 2.0f) > nominal_speed) {
+		if (acc - servo->run_jerk * CYCLE_TIME <= 0.0f) {
+			// Acceleration fully released, we are at nominal speed
+			acc = 0.0f;
+			speed = nominal_speed;
+		} else {
+			// Rounding must not cut the release short on the nominal speed
+			acc -= servo->run_jerk * CYCLE_TIME;
+			speed = fminf(speed + acc * CYCLE_TIME, nominal_speed);
+		}
+	} else {
+		s_curve_step(servo, &speed, &acc, servo->run_jerk);
+	}
+
+	const float remaining = (servo->next_stop - servo->set_pos) * direction;
+	if (s_curve_travel(servo, speed, acc) > remaining) {
+		return true;
+	}
+
+	servo->nominal_speed_reached = speed >= nominal_speed;
+	servo->computed_speed = speed * direction;
+	servo->computed_acc = acc * direction;
+	return false;
+}
+
+/**
+ * Travel of the braking plan after the given time since braking started,
+ * after the end of the plan the end speed is kept. Speed and acceleration,
+ * given at the start of braking, are updated to the values at that time.
+ * Works with magnitudes in the direction of movement.
+ */
+float s_curve_plan_travel(const servo_t* const servo, float time, float* const speed, float* const acc) {
+	const float jerks[3] = {servo->brake_jerk, 0.0f, servo->run_jerk};
+	float distance = 0.0f;
+	for (int i = 0; i < 3 && time > 0.0f; i++) {
+		const float segment = fminf(time, servo->brake_times[i]);
+		distance += integrate_segment(speed, acc, jerks[i], segment);
+		time -= segment;
+	}
+	return distance + *speed * time;
+}
+
+/**
+ * Segment times of the braking plan with given peak deceleration. The
+ * acceleration goes to -dec, is held there until the speed left is the one
+ * releasing it takes, then released to zero at the end speed.
+ * Returns the travel of the plan.
+ */
+float s_curve_plan_braking_dec(servo_t* const servo, const float dec) {
+	const float jerk = servo->run_jerk;
+	float speed = servo->brake_speed;
+	float acc = servo->brake_acc;
+	servo->brake_jerk = acc + dec > 0.0f ? -jerk : jerk;
+	servo->brake_times[0] = fabsf(acc + dec) / jerk;
+	integrate_segment(&speed, &acc, servo->brake_jerk, servo->brake_times[0]);
+	servo->brake_times[1] = fmaxf((speed - servo->end_speed - dec * dec / (2.0f * jerk)) / dec, 0.0f);
+	servo->brake_times[2] = dec / jerk;
+
+	speed = servo->brake_speed;
+	acc = servo->brake_acc;
+	return s_curve_plan_travel(servo, servo->brake_times[0] + servo->brake_times[1] + servo->brake_times[2], &speed, &acc);
+}
+
+/**
+ * Plans braking from the current speed and acceleration to the end speed
+ * at the stop position. Travel falls with the peak deceleration, the one
+ * landing on the stop position is found by bisection. Stop positions closer
+ * than braking with full deceleration are reached by the last cycle.
+ */
+void s_curve_plan_braking(servo_t* const servo) {
+	const float direction = servo->positive_direction ? 1.0f : -1.0f;
+	const float remaining = (servo->next_stop - servo->set_pos) * direction;
+	servo->brake_planned = true;
+	servo->brake_start = servo->set_pos;
+	servo->brake_stop = servo->next_stop;
+	servo->brake_end_speed = servo->end_speed;
+	servo->brake_time = 0.0f;
+	servo->brake_speed = servo->computed_speed * direction;
+	servo->brake_acc = servo->computed_acc * direction;
+
+	// Releasing the deceleration alone already takes all the speed, stop at once
+	const float jerk = servo->run_jerk;
+	const float speed = servo->brake_speed - servo->end_speed;
+	const float acc = servo->brake_acc;
+	if (speed + acc * fabsf(acc) / (2.0f * jerk) <= 0.0f) {
+		servo->brake_times[0] = 0.0f;
+		servo->brake_times[1] = 0.0f;
+		servo->brake_times[2] = 0.0f;
+		return;
+	}
+
+	// Deceleration is limited by the acceleration limit and by the triangular
+	// profile, which has no time left to hold it
+	float low = 0.0f;
+	float high = fminf(servo->run_acc, sqrtf(jerk * speed + acc * acc / 2.0f));
+	for (int i = 0; i < 16; i++) {
+		const float dec = (low + high) / 2.0f;
+		if (s_curve_plan_braking_dec(servo, dec) > remaining) {
+			low = dec;
+		} else {
+			high = dec;
+		}
+	}
+	s_curve_plan_braking_dec(servo, high);
+}
+
+/**
+ * One cycle of the S-curve braking phase. The braking plan is followed in
+ * time, it is made again when its stop position or end speed changes.
+ * Speed and acceleration reach the end speed and zero together right at
+ * the stop position. Returns true when the end speed has been reached.
+ */
+bool s_curve_brake(servo_t* const servo) {
+	if (!servo->brake_planned || servo->next_stop != servo->brake_stop || servo->end_speed != servo->brake_end_speed) {
+		s_curve_plan_braking(servo);
+	}
+
+	const float direction = servo->positive_direction ? 1.0f : -1.0f;
+	servo->brake_time += CYCLE_TIME;
+	const bool finished = servo->brake_time >= servo->brake_times[0] + servo->brake_times[1] + servo->brake_times[2];
+	float speed = servo->brake_speed;
+	float acc = servo->brake_acc;
+	float position = servo->brake_start + direction * s_curve_plan_travel(servo, servo->brake_time, &speed, &acc);
+	if (finished) {
+		// Stop lands exactly, a blend passes the stop position at the end speed
+		if (servo->end_speed <= 0.0f) {
+			position = servo->next_stop;
+		}
+		acc = 0.0f;
+		servo->brake_planned = false;
+	}
+
+	// Speed over the cycle, positions of the plan are hit without summing up rounding
+	servo->computed_speed = (position - servo->set_pos) / CYCLE_TIME;
+	servo->computed_acc = acc * direction;
+	return finished;
+}
+
+/**
+ * Speed factor of the next movement, 1 until the model comes close to its
+ * limit, then falling to THERMAL_GOVERN_MIN at the fault level. Repeated
+ * movements settle where they heat as much as the drive cools.
+ */
+float thermal_governor(const servo_t* const servo) {
+	const float load = servo->thermal / servo->thermal_limit;
+	if (load <= THERMAL_GOVERN_START) {
+		return 1.0f;
+	}
+	const float factor = 1.0f - (1.0f - THERMAL_GOVERN_MIN) * (load - THERMAL_GOVERN_START) / (THERMAL_FAULT - THERMAL_GOVERN_START);
+	return fmaxf(factor, THERMAL_GOVERN_MIN);
+}
+
+/**
+ * Limits of the active movement, the commanded ones derated when the drive
+ * is hot. The movement is stretched in time, speed scales by the factor of
+ * the governor, acceleration by its square and jerk by its cube.
+ */
+void run_limits_compute(servo_t* const servo) {
+	const float governor = thermal_governor(servo);
+	servo->run_speed = servo->nominal_speed * governor;
+	servo->run_acc = servo->move_acc * governor * governor;
+	servo->run_jerk = servo->move_jerk * governor * governor * governor;
+}
+
+/**
+ * Speed at which the active movement may pass its stop position and flow
+ * into the next queued movement. Zero when the next movement reverses,
+ * has to wait, or is too short to stop from that speed.
+ */
+float queue_end_speed(const servo_t* const servo, const bool positive_direction, const float speed) {
+	if (servo->queue_count == 0) {
+		return 0.0f;
+	}
+
+	const motion_segment_t* next = &servo->queue[servo->queue_head];
+	if (next->dwell > 0 || (next->position >= servo->next_stop) != positive_direction) {
+		return 0.0f;
+	}
+
+	// The next movement has to be able to stop within its own length, with
+	// the limits the governor leaves it
+	const float governor = thermal_governor(servo);
+	const float length = fabsf(next->position - servo->next_stop);
+	const float acc = servo->nominal_acc * governor * governor;
+	const float jerk = servo->nominal_jerk * governor * governor * governor;
+	float low = 0.0f;
+	float high = (speed < next->speed ? speed : next->speed) * governor;
+	for (int i = 0; i < 16; i++) {
+		float end_speed = (low + high) / 2.0f;
+		float distance = servo->profile == PROFILE_S_CURVE ?
+			get_jerk_limited_breaking_distance(end_speed, 0.0f, acc, jerk, 0.0f) :
+			end_speed * end_speed / (2.0f * acc);
+		if (distance > length) {
+			high = end_speed;
+		} else {
+			low = end_speed;
+		}
+	}
+	return low;
+}
+
+/**
+ * Takes the oldest queued movement and makes it the active one
+ */
+void queue_activate_next(servo_t* const servo) {
+	motion_segment_t* segment = &servo->queue[servo->queue_head];
+	servo->queue_head = (servo->queue_head + 1) % MOTION_QUEUE_SIZE;
+	servo->queue_count--;
+
+	servo->next_stop = segment->position;
+	servo->nominal_speed = segment->speed;
+	servo->move_acc = servo->nominal_acc;
+	servo->move_jerk = servo->nominal_jerk;
+	servo->delay_start = segment->dwell;
+	if (segment->event != NULL) {
+		segment->event();
+	}
+	servo->end_speed = queue_end_speed(servo, servo->next_stop >= servo->set_pos, servo->nominal_speed);
+}
+
+/**
+ * Called when the active movement has reached its end speed. Continues
+ * without stopping into the next queued movement if the end speed allows it.
+ */
+bool queue_blend_next(servo_t* const servo) {
+	if (servo->end_speed <= 0.0f || servo->queue_count == 0) {
+		return false;
+	}
+
+	queue_activate_next(servo);
+	run_limits_compute(servo);
+	servo->current_speed = servo->positive_direction ? servo->run_speed : -servo->run_speed;
+	servo->current_acc = servo->positive_direction ? servo->run_acc : -servo->run_acc;
+	servo->end_speed = queue_end_speed(servo, servo->positive_direction, servo->nominal_speed);
+	servo->positioning = ACCELERATING;
+	return true;
+}
+
+/**
+ * Acceleration and braking phases of the S-curve profile
+ */
+void s_curve_positon_compute(servo_t* const servo) {
+	if (servo->positioning == ACCELERATING && s_curve_accelerate(servo)) {
+		servo->positioning = BRAKING;
+		servo->brake_planned = false;
+	}
+
+	if (servo->positioning == BRAKING) {
+		servo->nominal_speed_reached = false;
+		if (s_curve_brake(servo) && !queue_blend_next(servo)) {
+			servo->positioning = POSITION_REACHED;
+		}
+	}
+
+	// Compute position for next cycle time
+	servo->set_pos += servo->computed_speed * CYCLE_TIME;
+}
+
+/**
+ * Heats the model by the duty of the last cycle
+ */
+void thermal_compute(servo_t* const servo) {
+	const float duty = (float)servo->duty / PWM_DUTY_FULL;
+	servo->thermal += (duty * duty - servo->thermal) * CYCLE_TIME / servo->thermal_time;
 }
 
 void servo_stop_positioning(servo_t* const servo) {
+	servo_queue_clear(servo);
 	servo->next_stop = servo->set_pos + get_breaking_distance(servo);
 }
 
@@ -139,36 +817,58 @@ void next_positon_compute(servo_t* const servo) {
 	switch(servo->positioning) {
         case IDLE:
 			servo->nominal_speed_reached = false;
+			if (servo->queue_count > 0) {
+				queue_activate_next(servo);
+				servo->positioning = REQUESTED;
+			}
 			break;
 		
 		case REQUESTED:
 			// First occurence of movement request, save the position of movement beginning
+			run_limits_compute(servo);
 			if (servo->next_stop >= servo->enc_position) {
 				// Positive direction
 				servo->positive_direction = true;
-				servo->current_acc = servo->nominal_acc;
-				servo->current_speed = servo->nominal_speed;
+				servo->current_acc = servo->run_acc;
+				servo->current_speed = servo->run_speed;
 			} else {
 				// Negative direction
 				servo->positive_direction = false;
-				servo->current_acc = -servo->nominal_acc;
-				servo->current_speed = -servo->nominal_speed;
+				servo->current_acc = -servo->run_acc;
+				servo->current_speed = -servo->run_speed;
 			}
 			if (servo->delay_start > 0) {
 				servo->delay_start--;
 				break;
 			}
 			servo->computed_speed = 0.0;
+			servo->computed_acc = 0.0;
 			servo->positioning = ACCELERATING;
+
+			// New movement overwrites the oldest record of peaks
+			servo->fe_move = (servo->fe_move + 1) % FOLLOWING_ERROR_MOVES;
+			memset(servo->fe_peaks[servo->fe_move], 0, sizeof(servo->fe_peaks[servo->fe_move]));
+			servo->est_samples = 0;
+			servo->est_sum_a = 0.0f;
+			servo->est_sum_u = 0.0f;
+			servo->est_sum_aa = 0.0f;
+			servo->est_sum_au = 0.0f;
 			break;
 
 		case ACCELERATING:
-			servo->computed_speed += servo->current_acc * CYCLE_TIME;
+			if (servo->profile == PROFILE_S_CURVE) {
+				s_curve_positon_compute(servo);
+				break;
+			} else {
+				servo->computed_speed += servo->current_acc * CYCLE_TIME;
+				servo->computed_acc = servo->current_acc;
 
-			// check if nominal speed has been reached
-			if (fabs(servo->computed_speed) > fabs(servo->current_speed)) {
-				servo->nominal_speed_reached = true;
-				servo->computed_speed = servo->current_speed;
+				// check if nominal speed has been reached
+				if (fabsf(servo->computed_speed) > fabsf(servo->current_speed)) {
+					servo->nominal_speed_reached = true;
+					servo->computed_speed = servo->current_speed;
+					servo->computed_acc = 0.0;
+				}
 			}
 
 			// Compute position for next cycle time
@@ -187,54 +887,484 @@ void next_positon_compute(servo_t* const servo) {
 			break;
 
 		case BRAKING:
-			servo->computed_speed -= servo->current_acc * CYCLE_TIME;
+			if (servo->profile == PROFILE_S_CURVE) {
+				s_curve_positon_compute(servo);
+				break;
+			}
+
+			// Deceleration which lands exactly on the stop position, the discrete
+			// steps travel (v^2 - e^2) / 2a - (v - e) * dt / 2 before reaching the end speed
+			float braking_acc = servo->current_acc;
+			const float direction = servo->positive_direction ? 1.0f : -1.0f;
+			const float remaining = (servo->next_stop - servo->set_pos) * direction;
+			const float speed = servo->computed_speed * direction;
+			if (remaining > 0.0f && speed > servo->end_speed) {
+				braking_acc = direction * (speed * speed - servo->end_speed * servo->end_speed) /
+					(2.0f * remaining + (speed - servo->end_speed) * CYCLE_TIME);
+			}
+
+			servo->computed_speed -= braking_acc * CYCLE_TIME;
+			servo->computed_acc = -braking_acc;
 			servo->set_pos += servo->computed_speed * CYCLE_TIME;
 			servo->nominal_speed_reached = false;
 			
-			// Check if desired position has been reached
+			// Check if desired position or end speed has been reached
 			if (servo->positive_direction) {
-				if (servo->computed_speed <= 0.0) {
-					servo->positioning = POSITION_REACHED;
+				if (servo->computed_speed <= servo->end_speed) {
+					servo->positioning = queue_blend_next(servo) ? ACCELERATING : POSITION_REACHED;
 				}
 			} else {
-				if (servo->computed_speed >= 0.0) {
-					servo->positioning = POSITION_REACHED;
+				if (servo->computed_speed >= -servo->end_speed) {
+					servo->positioning = queue_blend_next(servo) ? ACCELERATING : POSITION_REACHED;
 				}
 			}
 			break;
 
 		case POSITION_REACHED:
+			servo->computed_speed = 0.0;
+			servo->computed_acc = 0.0;
 			servo->set_pos = servo->next_stop;
 			servo->positioning = IDLE;
 			break;
 	}
 }
 
+/**
+ * Moves the backlash offset towards half of the lash in the direction of
+ * the commanded movement. The offset is ramped with limited speed and
+ * acceleration, so a reversal does not kick the position setpoint.
+ */
+void backlash_compute(servo_t* const servo) {
+	if (servo->computed_speed > 0.0f) {
+		servo->backlash_direction = 1;
+	} else if (servo->computed_speed < 0.0f) {
+		servo->backlash_direction = -1;
+	}
+
+	const float target = servo->backlash_direction * servo->backlash / 2.0f;
+	const float remaining = target - servo->backlash_offset;
+	if (remaining == 0.0f) {
+		servo->backlash_speed = 0.0f;
+		return;
+	}
+
+	// Fastest speed which still stops on the target when it drops by one step
+	// every cycle, changed by limited acceleration. The last cycle lands on it.
+	const float step = BACKLASH_ACC * CYCLE_TIME;
+	const float stopping = (sqrtf(step * step + 8.0f * BACKLASH_ACC * fabsf(remaining)) - step) / 2.0f;
+	float speed = copysignf(fminf(fminf(stopping, BACKLASH_SPEED), fabsf(remaining) / CYCLE_TIME), remaining);
+	speed = fminf(fmaxf(speed, servo->backlash_speed - step), servo->backlash_speed + step);
+	servo->backlash_offset += speed * CYCLE_TIME;
+	servo->backlash_speed = speed;
+	if ((target - servo->backlash_offset) * remaining <= 0.0f) {
+		servo->backlash_offset = target;
+		servo->backlash_speed = 0.0f;
+	}
+}
+
+/**
+ * Stops recording or replay, the profile is computed from the current state on
+ */
+void cache_abort(servo_t* const servo) {
+	if (servo->cache_mode == CACHE_RECORD) {
+		profile_cache_record_abort(servo->cache);
+	}
+	servo->cache_mode = CACHE_OFF;
+}
+
+/**
+ * Called when the movement leaves REQUESTED. A movement which was recorded
+ * before is replayed, otherwise it is recorded. Movements blending into the
+ * next one are not cached.
+ */
+void cache_begin(servo_t* const servo) {
+	if (servo->cache == NULL || servo->end_speed != 0.0f) {
+		return;
+	}
+
+	const profile_key_t key = {servo->set_pos, servo->next_stop, servo->run_speed,
+		servo->run_acc, servo->run_jerk, (uint8_t)servo->profile};
+	servo->cache_start = servo->set_pos;
+	servo->cache_target = servo->next_stop;
+	servo->cache_sample = 0;
+	if (profile_cache_replay_start(servo->cache, &key, &servo->cache_marks)) {
+		servo->cache_mode = CACHE_REPLAY;
+	} else {
+		profile_cache_record_start(servo->cache, &key);
+		servo->cache_marks.speed_reached = UINT32_MAX;
+		servo->cache_marks.braking = UINT32_MAX;
+		servo->cache_mode = CACHE_RECORD;
+	}
+}
+
+/**
+ * Records the cycle just computed, the movement is stored when it ends
+ */
+void cache_record_compute(servo_t* const servo) {
+	if (!profile_cache_record(servo->cache, servo->set_pos - servo->cache_start)) {
+		servo->cache_mode = CACHE_OFF;
+		return;
+	}
+
+	if (servo->nominal_speed_reached && servo->cache_marks.speed_reached == UINT32_MAX) {
+		servo->cache_marks.speed_reached = servo->cache_sample;
+	}
+	if (servo->positioning != ACCELERATING && servo->cache_marks.braking == UINT32_MAX) {
+		servo->cache_marks.braking = servo->cache_sample;
+	}
+	servo->cache_sample++;
+
+	if (servo->positioning == POSITION_REACHED) {
+		profile_cache_record_finish(servo->cache, &servo->cache_marks);
+		servo->cache_mode = CACHE_OFF;
+	}
+}
+
+/**
+ * Replays one cycle of the cached movement, speed and acceleration follow
+ * from the stored changes of position
+ */
+void cache_replay_compute(servo_t* const servo) {
+	float position, step, step_change;
+	profile_cache_replay_next(servo->cache, &position, &step, &step_change);
+	servo->set_pos = servo->cache_start + position;
+	servo->computed_speed = step / CYCLE_TIME;
+	servo->computed_acc = step_change / (CYCLE_TIME * CYCLE_TIME);
+
+	const uint32_t sample = servo->cache_sample++;
+	servo->nominal_speed_reached = sample >= servo->cache_marks.speed_reached && sample < servo->cache_marks.braking;
+	servo->positioning = sample >= servo->cache_marks.braking ? BRAKING : ACCELERATING;
+	servo->brake_planned = false;
+	if (servo->cache_sample >= servo->cache_marks.length) {
+		servo->computed_acc = 0.0f;
+		servo->positioning = POSITION_REACHED;
+		servo->cache_mode = CACHE_OFF;
+	}
+}
+
+/**
+ * Profile of the next cycle, replayed from the cache when possible
+ */
+void profile_compute(servo_t* const servo) {
+	const enum positioning previous = servo->positioning;
+
+	// Plan changed by goto, retarget, stop or blending, the cached sequence no longer leads there
+	if (servo->cache_mode != CACHE_OFF &&
+		((previous != ACCELERATING && previous != BRAKING) ||
+		servo->next_stop != servo->cache_target || servo->end_speed != 0.0f)) {
+		cache_abort(servo);
+	}
+
+	if (servo->cache_mode == CACHE_REPLAY) {
+		cache_replay_compute(servo);
+		return;
+	}
+
+	next_positon_compute(servo);
+	if (servo->cache_mode == CACHE_RECORD) {
+		cache_record_compute(servo);
+	} else if (previous == REQUESTED && servo->positioning == ACCELERATING) {
+		cache_begin(servo);
+	}
+}
+
+/**
+ * Phase of the profile from its commanded speed and acceleration
+ */
+servo_phase_t servo_phase(const servo_t* const servo) {
+	if (servo->computed_speed == 0.0f && servo->computed_acc == 0.0f) {
+		return SERVO_PHASE_STANDSTILL;
+	}
+	if (fabsf(servo->computed_acc) < PHASE_CRUISE_ACC * servo->nominal_acc) {
+		return SERVO_PHASE_CRUISE;
+	}
+	return servo->computed_speed * servo->computed_acc >= 0.0f ? SERVO_PHASE_ACCEL : SERVO_PHASE_DECEL;
+}
+
+/**
+ * Checks the following error against the envelope given by the commanded
+ * speed and acceleration and records its peak for the current phase
+ */
+void following_error_compute(servo_t* const servo) {
+	const float error = fabsf(servo->enc_position - servo->set_pos);
+	servo->fe_limit = servo->fe_static + servo->fe_per_speed * fabsf(servo->computed_speed)
+		+ servo->fe_per_acc * fabsf(servo->computed_acc);
+	if (error >= servo->fe_limit) {
+		servo->pos_error_internal = true;
+	}
+	servo->following_error = (servo->set_pos - servo->enc_position) * servo->scale;
+
+	float* peak = &servo->fe_peaks[servo->fe_move][servo_phase(servo)];
+	if (error > *peak) {
+		*peak = error;
+	}
+}
+
+/**
+ * Friction feedforward at the commanded position and speed, while learning
+ * the effort of the controller is recorded instead. Effort is taken only at
+ * cruise speed which the axis follows, then it is all friction.
+ */
+int friction_compute(servo_t* const servo) {
+	if (servo->friction == NULL) {
+		return 0;
+	}
+
+	if (servo->friction_learning) {
+		if (servo->nominal_speed_reached && servo_phase(servo) == SERVO_PHASE_CRUISE &&
+			fabsf(servo->enc_speed - servo->computed_speed) <= FRICTION_LEARN_TOLERANCE * fabsf(servo->computed_speed)) {
+			friction_map_learn(servo->friction, servo->enc_position, servo->computed_speed, (float)servo->output);
+		}
+		return 0;
+	}
+
+	const float fade = fminf(fabsf(servo->computed_speed) / FRICTION_FADE_SPEED, 1.0f);
+	return (int)(fade * friction_map_get(servo->friction, servo->set_pos, servo->computed_speed));
+}
+
+/**
+ * Gains interpolated from the schedule at the estimated inertia
+ */
+void gain_schedule_apply(servo_t* const servo) {
+	if (servo->gain_sets == 0 || servo->inertia <= 0.0f) {
+		return;
+	}
+
+	float kp, ki, kd;
+	pid_schedule(servo->pos_sets, servo->gain_sets, servo->inertia, &kp, &ki, &kd);
+	pid_set_tunings(servo->pid_pos, kp, ki, kd);
+	pid_schedule(servo->vel_sets, servo->gain_sets, servo->inertia, &servo->vel_kp, &servo->vel_ki, &servo->vel_kd);
+	apply_velocity_gains(servo);
+}
+
+/**
+ * Estimates the inertia from the accelerating phases of a movement. Effort
+ * is u = J * a + friction, the slope of effort over acceleration is taken by
+ * least squares when the movement ends. Speed and effort pass the same
+ * filter, so the acceleration from the filtered speed stays aligned with the
+ * effort which caused it.
+ */
+void inertia_compute(servo_t* const servo) {
+	const float gain = 1.0f / (1.0f + INERTIA_FILTER);
+	const float previous = servo->est_speed;
+	servo->est_speed += gain * (servo->enc_speed - servo->est_speed);
+	servo->est_output += gain * ((float)servo->output - servo->est_output);
+	const float acc = (servo->est_speed - previous) / CYCLE_TIME;
+
+	if (fabsf(servo->computed_acc) >= INERTIA_MIN_ACC * servo->run_acc && servo->est_samples < UINT16_MAX) {
+		servo->est_sum_a += acc;
+		servo->est_sum_u += servo->est_output;
+		servo->est_sum_aa += acc * acc;
+		servo->est_sum_au += acc * servo->est_output;
+		servo->est_samples++;
+	}
+
+	if (servo->positioning != POSITION_REACHED || servo->est_samples < INERTIA_MIN_SAMPLES) {
+		return;
+	}
+
+	const float n = (float)servo->est_samples;
+	const float variance = servo->est_sum_aa / n - (servo->est_sum_a / n) * (servo->est_sum_a / n);
+	const float covariance = servo->est_sum_au / n - (servo->est_sum_a / n) * (servo->est_sum_u / n);
+	servo->est_samples = 0;
+	if (variance <= 0.0f || covariance <= 0.0f) {
+		return;
+	}
+
+	const float inertia = covariance / variance;
+	servo->inertia = servo->inertia > 0.0f ? servo->inertia + INERTIA_ADAPT * (inertia - servo->inertia) : inertia;
+	observer_set_input_gain(servo->observer, 1.0f / servo->inertia);
+	if (servo->gain_store_pending) {
+		servo_store_gain_set(servo);
+	}
+	gain_schedule_apply(servo);
+}
+
+/**
+ * Counts consecutive cycles with finished profile, encoder position within
+ * the window around the stop position and speed under the threshold.
+ * Every movement has to settle within SETTLE_TIMEOUT cycles after its
+ * profile finished, waits for servo_is_settled can not hang then.
+ */
+void settle_compute(servo_t* const servo) {
+	const bool finished = servo->positioning == IDLE && servo->queue_count == 0;
+	if (finished &&
+		fabsf(servo->enc_position - servo->set_pos) <= servo->settle_window &&
+		fabsf(servo->enc_speed) <= servo->settle_speed) {
+		if (servo->settle_count < servo->settle_ticks) {
+			servo->settle_count++;
+		}
+	} else {
+		servo->settle_count = 0;
+	}
+
+	if (!finished) {
+		servo->settle_armed = true;
+		servo->settle_wait = 0;
+	} else if (servo->settle_count >= servo->settle_ticks) {
+		servo->settle_armed = false;
+	} else if (servo->settle_armed && servo->settle_wait < SETTLE_TIMEOUT) {
+		servo->settle_wait++;
+	}
+}
+
 void servo_reset_all(servo_t* const servo) {
 	pid_reset_all(servo->pid_pos);
 	pid_reset_all(servo->pid_vel);
+	servo_queue_clear(servo);
 	servo->positioning = IDLE;
 	servo->pos_error_internal = false;
+	servo->settle_armed = false;
+	servo->settle_wait = 0;
 	servo->computed_speed = 0.0;
+	servo->computed_acc = 0.0;
 	servo->set_pos = servo->enc_position;
 }
 
-void servo_compute(servo_t* const servo) { 
+void servo_latch_encoder(servo_t* const servo) {
+	quadrature_encoder_dma_restart(servo->enc_tx_dma, servo->enc_rx_dma);
+	servo->enc_count = servo->enc_stream;
+}
+
+/**
+ * Sets the H-bridge, the duty is kept for the thermal model
+ */
+void servo_pwm(servo_t* const servo, const uint slice, const int duty) {
+	servo->duty = duty;
+	set_two_chans_pwm(slice, duty);
+}
+
+/**
+ * Maps controller duty to PWM duty and sets the output. Breakaway duty of
+ * the direction is added, so small commands already move the motor through
+ * the H-bridge deadzone and static friction. Inside the deadband the
+ * compensation is ramped in from zero to avoid chatter at standstill.
+ */
+void servo_output(servo_t* const servo, int duty) {
+	duty = duty > OUTPUT_LIMIT ? OUTPUT_LIMIT : (duty < -OUTPUT_LIMIT ? -OUTPUT_LIMIT : duty);
+	servo->output = duty;
+	const int breakaway = duty >= 0 ? servo->breakaway_pos : servo->breakaway_neg;
+	const int magnitude = duty >= 0 ? duty : -duty;
+	int mapped;
+	if (magnitude < OUTPUT_DEADBAND) {
+		mapped = magnitude * (breakaway + OUTPUT_DEADBAND * (OUTPUT_LIMIT - breakaway) / OUTPUT_LIMIT) / OUTPUT_DEADBAND;
+	} else {
+		mapped = breakaway + magnitude * (OUTPUT_LIMIT - breakaway) / OUTPUT_LIMIT;
+	}
+	servo_pwm(servo, servo->pwm_slice, duty >= 0 ? mapped : -mapped);
+}
+
+/**
+ * Runs one cycle of the relay experiment instead of the profile. Velocity
+ * loop is tuned by relay on PWM, position loop by relay on velocity setpoint.
+ */
+void servo_tune_compute(servo_t* const servo) {
+	if (fabsf(servo->enc_position - servo->tune_start) > servo->tune_travel) {
+		autotune_abort(servo->tuner);
+	}
+
+	int pwm;
+	if (servo->tune_loop == SERVO_LOOP_VELOCITY) {
+		pwm = (int)autotune_compute(servo->tuner, servo->enc_speed);
+	} else {
+		servo->set_vel = autotune_compute(servo->tuner, servo->enc_position);
+		pid_compute(servo->pid_vel);
+		pwm = (int)servo->out_vel;
+	}
+	servo->following_error = 0.0f;
+
+	// Finished or failed, hold the position where the experiment ended
+	if (autotune_get_state(servo->tuner) != AUTOTUNE_RUNNING) {
+		servo->tuning = false;
+		servo_reset_all(servo);
+		servo_pwm(servo, servo->pwm_slice, 0);
+	} else {
+		servo_output(servo, pwm);
+	}
+}
+
+/**
+ * Runs one cycle of the breakaway calibration instead of the profile. Duty
+ * is ramped up slowly without the output map until the axis moves, first
+ * in positive then in negative direction.
+ */
+void servo_calibrate_compute(servo_t* const servo) {
+	const float moved = (servo->enc_position - servo->calib_start) * servo->calib_direction;
+	if (fabsf(servo->enc_position - servo->tune_start) > servo->tune_travel) {
+		servo->calib_state = AUTOTUNE_FAILED;
+	} else if (servo->calib_rest > 0) {
+		servo->calib_duty = 0.0f;
+		if (--servo->calib_rest == 0) {
+			servo->calib_start = servo->enc_position;
+		}
+	} else if (moved >= CALIB_MOVE) {
+		servo->calib_result[servo->calib_direction > 0 ? 0 : 1] = (int)servo->calib_duty;
+		servo->calib_duty = 0.0f;
+		if (servo->calib_direction > 0) {
+			servo->calib_direction = -1;
+			servo->calib_rest = CALIB_REST;
+		} else {
+			servo->calib_state = AUTOTUNE_FINISHED;
+		}
+	} else {
+		servo->calib_duty += CALIB_RAMP;
+		if (servo->calib_duty > CALIB_MAX_DUTY) {
+			servo->calib_state = AUTOTUNE_FAILED;
+		}
+	}
+	servo->following_error = 0.0f;
+
+	// Finished or failed, hold the position where the calibration ended
+	if (servo->calib_state != AUTOTUNE_RUNNING) {
+		servo->calibrating = false;
+		servo_reset_all(servo);
+		servo_pwm(servo, servo->pwm_slice, 0);
+	} else {
+		servo_pwm(servo, servo->pwm_slice, servo->calib_direction * (int)servo->calib_duty);
+	}
+
+	// Duty below breakaway does not accelerate the axis, observer sees no input
+	servo->output = 0;
+}
+
+/**
+ * Difference of two state machine counts, correct across the 32-bit wrap
+ */
+int32_t enc_count_diff(const int32_t count, const int32_t previous) {
+	return (int32_t)((uint32_t)count - (uint32_t)previous);
+}
+
+void servo_compute(servo_t* const servo) {
 	// Get current position, calculate velocity
-	int32_t enc_new = quadrature_encoder_get_count(pio0, servo->sm);
-	servo->enc_position = ((float)enc_new / 4000.0) - servo->enc_offset;
+	// Position is converted to float relative to the origin only, so it keeps
+	// full resolution no matter how far the axis has travelled.
+	// Backlash offset follows the movement commanded in the last cycle, the
+	// position is then the load position and the controller works with it.
+	int32_t enc_new = servo->enc_count;
+	const int32_t enc_delta = enc_count_diff(enc_new, servo->enc_old);
+	servo->enc_extended += enc_delta;
+	backlash_compute(servo);
+	servo->enc_position = (float)(servo->enc_extended - servo->enc_origin) / 4000.0f - servo->backlash_offset;
+	// Output of the last cycle is the input which moved the axis since then
+	observer_update(servo->observer, enc_blended_speed(servo, enc_delta) / 4000.0f, (float)servo->output);
+	servo->enc_speed = observer_get_velocity(servo->observer);
+	servo->enc_acc = observer_get_acceleration(servo->observer);
+	thermal_compute(servo);
+	servo->enc_old = enc_new; // Needed for velocity calculation
 	if (servo->set_zero) {
-		servo->enc_offset = servo->enc_position;
-		servo->enc_position = 0.0;
+		servo->enc_origin = servo->enc_extended;
+		servo->enc_position = -servo->backlash_offset;
 		pid_reset_all(servo->pid_pos);
 		pid_reset_all(servo->pid_vel);
-		servo->set_pos = 0.0;
+		servo->set_pos = servo->enc_position;
 		servo->set_zero = false;
 	}
-	servo->enc_speed = enc2speed(enc_new - servo->enc_old);
-	servo->enc_old = enc_new; // Needed for velocity calculation
 
-	if (*servo->enable) {
+	if (*servo->enable && servo->tuning) {
+		servo_tune_compute(servo);
+	} else if (*servo->enable && servo->calibrating) {
+		servo_calibrate_compute(servo);
+	} else if (*servo->enable) {
 		// Reset All on positive edge of enable
 		if (servo->enable_previous) {
 			servo->enable_previous = false;
@@ -242,14 +1372,26 @@ void servo_compute(servo_t* const servo) {
 		}
 
 		// Evaluate following error
-		if (fabs(servo->enc_position - servo->set_pos) >= FOLLOWING_ERROR)
-			servo->pos_error_internal = true;
+		following_error_compute(servo);
 
-		next_positon_compute(servo);
+		profile_compute(servo);
+		settle_compute(servo);
+		inertia_compute(servo);
 
-		// PID Computation
+		// PID Computation, output limits leave room for the feedforward
+		// so anti-windup acts on the real saturation. Motor runs ahead of
+		// the profile while the backlash is taken up.
+		const float speed_ff = servo->kvff * (servo->computed_speed + servo->backlash_speed);
+		const int pwm_ff = (int)(servo->kaff * servo->computed_acc) + friction_compute(servo);
+		pid_set_output_limits(servo->pid_pos, -OUTPUT_LIMIT - speed_ff, OUTPUT_LIMIT - speed_ff);
 		pid_compute(servo->pid_pos);
-		servo->set_vel = servo->out_pos; // Positional --> Velocity PID
+
+		// Positional --> Velocity PID, profile speed is fed forward so the
+		// position loop only corrects the remaining error
+		float set_vel = servo->out_pos + speed_ff;
+		set_vel = fminf(fmaxf(set_vel, -OUTPUT_LIMIT), OUTPUT_LIMIT);
+		pid_set_output_limits(servo->pid_vel, (float)(-OUTPUT_LIMIT - pwm_ff), (float)(OUTPUT_LIMIT - pwm_ff));
+		servo->set_vel = set_vel;
 		pid_compute(servo->pid_vel);
 		
 		// set_two_chans_pwm(servo->pwm_slice, servo->out_vel);
@@ -259,42 +1401,120 @@ void servo_compute(servo_t* const servo) {
 			*servo->error = true;
 		}
 
+		if (!*servo->error && servo->settle_wait >= SETTLE_TIMEOUT) {
+			strcpy(*servo->error_message, servo->servo_name);
+			strcat(*servo->error_message, ": Not Settled");
+			*servo->error = true;
+		}
+
+		if (!*servo->error && servo->thermal > servo->thermal_limit * THERMAL_FAULT) {
+			strcpy(*servo->error_message, servo->servo_name);
+			strcat(*servo->error_message, ": Overheat");
+			*servo->error = true;
+		}
+
 		if (!*servo->error && (pid_get_error(servo->pid_pos) || pid_get_error(servo->pid_vel))) {
 			strcpy(*servo->error_message, servo->servo_name);
 			strcat(*servo->error_message, ": PID Error");
 			*servo->error = true;
 		}
 
-		// PWM output
-		set_two_chans_pwm(servo->pwm_slice, servo->out_vel);
+		// PWM output with acceleration feedforward
+		servo_output(servo, (int)servo->out_vel + pwm_ff);
 	} else {
-		set_two_chans_pwm(servo->pwm_slice, 0.0);
+		servo_pwm(servo, servo->pwm_slice, 0);
+		servo->output = 0;
 		servo->enable_previous = true;
+		servo->following_error = 0.0f;
+		servo->settle_count = 0;
+		if (servo->tuning) {
+			autotune_abort(servo->tuner);
+			servo->tuning = false;
+		}
+		if (servo->calibrating) {
+			servo->calib_state = AUTOTUNE_FAILED;
+			servo->calibrating = false;
+		}
 	}
 	servo->servo_position = servo->enc_position * servo->scale;
 	servo->servo_speed = servo->enc_speed * servo->scale;
-}  
+}
 
-void _servo_goto(servo_t* const servo, const float position, const float speed) {
+void _servo_goto(servo_t* const servo, const float position, const float speed, const uint32_t delay) {
+	servo_queue_clear(servo);
 	servo->next_stop = position / servo->scale;
 	servo->nominal_speed = speed / servo->scale;
-	if (servo->delay_start == 0) {
-		servo->delay_start = 500;
-	}
-	else if (servo->delay_start == UINT32_MAX) { // TODO, add some sign to not add delay, e.g. maximum number
-		servo->delay_start = 0;
-	}
+	servo->move_acc = servo->nominal_acc;
+	servo->move_jerk = servo->nominal_jerk;
+	servo->delay_start = delay;
 	servo->positioning = REQUESTED;
 }
 
 void servo_goto_delayed(servo_t* const servo, const float position, const float speed, const uint32_t delay) {
-	servo->delay_start = delay;
-	_servo_goto(servo, position, speed);
+	_servo_goto(servo, position, speed, delay);
 }
 
 void servo_goto(servo_t* const servo, const float position, const float speed) {
-	servo->delay_start = UINT32_MAX;
-	_servo_goto(servo, position, speed);
+	_servo_goto(servo, position, speed, 0);
+}
+
+/**
+ * Time needed for a point-to-point movement from standstill to standstill
+ * with given speed, acceleration and jerk limits. Short movements which
+ * never reach the speed are solved for their peak speed.
+ */
+float profile_time(const float distance, const float speed, const float acc, const float jerk, const servo_profile_t profile) {
+	if (distance <= 0.0f || speed <= 0.0f) {
+		return 0.0f;
+	}
+
+	if (profile != PROFILE_S_CURVE) {
+		if (distance >= speed * speed / acc) {
+			return distance / speed + speed / acc;
+		}
+		return 2.0f * sqrtf(distance / acc);
+	}
+
+	// Time to reach the speed, the same time is needed to stop
+	float peak = speed;
+	float ramp = peak * jerk >= acc * acc ? peak / acc + acc / jerk : 2.0f * sqrtf(peak / jerk);
+	if (distance < peak * ramp) {
+		peak = acc / 2.0f * (-acc / jerk + sqrtf(acc * acc / (jerk * jerk) + 4.0f * distance / acc));
+		if (peak * jerk < acc * acc) {
+			peak = powf(distance * sqrtf(jerk) / 2.0f, 2.0f / 3.0f);
+		}
+		ramp = peak * jerk >= acc * acc ? peak / acc + acc / jerk : 2.0f * sqrtf(peak / jerk);
+	}
+	return distance / peak + ramp;
+}
+
+/**
+ * Time the servo needs to move to the position in user units with its nominal limits
+ */
+float servo_move_time(const servo_t* const servo, const float position, const float speed) {
+	return profile_time(fabsf(position / servo->scale - servo->set_pos), speed / servo->scale,
+		servo->nominal_acc, servo->nominal_jerk, servo->profile);
+}
+
+void servo_goto_synchronized(servo_t* const servos[], const float positions[], const float speeds[],
+							const uint8_t count, const uint32_t delay) {
+	float longest = 0.0f;
+	for (uint8_t i = 0; i < count; i++) {
+		const float time = servo_move_time(servos[i], positions[i], speeds[i]);
+		if (time > longest) {
+			longest = time;
+		}
+	}
+
+	for (uint8_t i = 0; i < count; i++) {
+		servo_t* servo = servos[i];
+		// Stretching the profile in time by k scales speed by 1/k, acceleration by 1/k^2 and jerk by 1/k^3
+		const float time = servo_move_time(servo, positions[i], speeds[i]);
+		const float k = time > 0.0f ? longest / time : 1.0f;
+		_servo_goto(servo, positions[i], speeds[i] / k, delay);
+		servo->move_acc = servo->nominal_acc / (k * k);
+		servo->move_jerk = servo->nominal_jerk / (k * k * k);
+	}
 }
 
 void servo_manual_handling(servo_t* const servo, const float min, const float max, const float speed, bool homed) {
@@ -310,11 +1530,9 @@ void servo_manual_handling(servo_t* const servo, const float min, const float ma
 		limit_max = 2000;
 	}
 	if (button_raised(servo->man_plus)) {
-		servo->delay_start = UINT32_MAX;
 		servo_goto(servo, servo->next_stop = limit_max, speed);
 	}
 	else if (button_raised(servo->man_minus)) {
-		servo->delay_start = UINT32_MAX;
 		servo_goto(servo, servo->next_stop = limit_min, speed);
 	}
 	else if (button_dropped(servo->man_plus) || button_dropped(servo->man_minus)) {
@@ -326,12 +1544,73 @@ float servo_get_position(const servo_t* const servo) {
 	return servo->servo_position;
 }
 
+float servo_get_observed_position(const servo_t* const servo) {
+	return (servo->enc_position + observer_get_offset(servo->observer)) * servo->scale;
+}
+
+float servo_get_speed(const servo_t* const servo) {
+	return servo->servo_speed;
+}
+
+float servo_get_acceleration(const servo_t* const servo) {
+	return servo->enc_acc * servo->scale;
+}
+
+void servo_set_observer_bandwidth(servo_t* const servo, const float bandwidth) {
+	observer_set_bandwidth(servo->observer, CYCLE_TIME, bandwidth);
+}
+
+float servo_get_following_error(const servo_t* const servo) {
+	return servo->following_error;
+}
+
+void servo_set_following_error_limits(servo_t* const servo, const float static_limit,
+									const float per_speed, const float per_acc) {
+	// Speed and acceleration allowances are in seconds, the same in user units and rev
+	servo->fe_static = static_limit / servo->scale;
+	servo->fe_per_speed = per_speed;
+	servo->fe_per_acc = per_acc;
+}
+
+float servo_get_following_error_limit(const servo_t* const servo) {
+	return servo->fe_limit * servo->scale;
+}
+
+float servo_get_following_error_peak(const servo_t* const servo, const servo_phase_t phase) {
+	float peak = 0.0f;
+	for (int i = 0; i < FOLLOWING_ERROR_MOVES; i++) {
+		if (servo->fe_peaks[i][phase] > peak) {
+			peak = servo->fe_peaks[i][phase];
+		}
+	}
+	return peak * servo->scale;
+}
+
+void servo_clear_following_error_peaks(servo_t* const servo) {
+	memset(servo->fe_peaks, 0, sizeof(servo->fe_peaks));
+}
+
 float* servo_get_position_pointer(servo_t* const servo) {
 	return &servo->servo_position;
 }
 
 bool servo_is_idle(const servo_t* const servo){
-	return servo->positioning == IDLE;
+	return servo->positioning == IDLE && servo->queue_count == 0;
+}
+
+bool servo_is_saturated(const servo_t* const servo) {
+	return pid_get_saturated(servo->pid_pos) || pid_get_saturated(servo->pid_vel);
+}
+
+bool servo_is_settled(const servo_t* const servo) {
+	return servo_is_idle(servo) && servo->settle_count >= servo->settle_ticks;
+}
+
+void servo_set_settle_window(servo_t* const servo, const float window, const float speed, const uint16_t ticks) {
+	servo->settle_window = window / servo->scale;
+	servo->settle_speed = speed / servo->scale;
+	servo->settle_ticks = ticks;
+	servo->settle_count = 0;
 }
 
 bool servo_is_accelerating(const servo_t* const servo) {
@@ -346,10 +1625,344 @@ bool servo_is_speed_reached(const servo_t* const servo) {
 	return servo->nominal_speed_reached;
 }
 
+bool servo_queue_move(servo_t* const servo, const float position, const float speed,
+					const uint32_t dwell, servo_event_t event) {
+	if (servo->queue_count >= MOTION_QUEUE_SIZE) {
+		return false;
+	}
+
+	motion_segment_t* segment = &servo->queue[(servo->queue_head + servo->queue_count) % MOTION_QUEUE_SIZE];
+	segment->position = position / servo->scale;
+	segment->speed = speed / servo->scale;
+	segment->dwell = dwell;
+	segment->event = event;
+	servo->queue_count++;
+
+	// Lookahead of the movement in progress may now blend into this one
+	if (servo->queue_count == 1 && (servo->positioning == REQUESTED || servo->positioning == ACCELERATING)) {
+		bool positive_direction = servo->positioning == REQUESTED ?
+			servo->next_stop >= servo->set_pos : servo->positive_direction;
+		servo->end_speed = queue_end_speed(servo, positive_direction, servo->nominal_speed);
+	}
+	return true;
+}
+
+void servo_queue_clear(servo_t* const servo) {
+	servo->queue_count = 0;
+	servo->end_speed = 0.0;
+}
+
+void servo_set_profile(servo_t* const servo, const servo_profile_t profile, const float jerk) {
+	servo->profile = profile;
+	if (jerk > 0.0f) {
+		servo->nominal_jerk = jerk / servo->scale;
+	}
+}
+
 void servo_set_stop_position(servo_t* const servo, const float position) {
 	servo->next_stop = position / servo->scale;
 }
 
+void servo_retarget(servo_t* const servo, const float position) {
+	const float target = position / servo->scale;
+
+	// Same target as planned, either directly or after the reversal
+	if (target == servo->next_stop ||
+		(servo->queue_count == 1 && servo->queue[servo->queue_head].position == target)) {
+		return;
+	}
+
+	if (servo->positioning == REQUESTED) {
+		servo_queue_clear(servo);
+		servo->next_stop = target;
+		servo->end_speed = 0.0f;
+		return;
+	}
+
+	if (servo->positioning == IDLE || servo->positioning == POSITION_REACHED) {
+		if (fabsf(target - servo->set_pos) >= RETARGET_DEADBAND) {
+			_servo_goto(servo, position, servo->nominal_speed * servo->scale, 0);
+		}
+		return;
+	}
+
+	// Moving, replan from the current speed and acceleration to a full stop
+	servo_queue_clear(servo);
+	servo->end_speed = 0.0f;
+	const float direction = servo->positive_direction ? 1.0f : -1.0f;
+	const float breaking_distance = get_breaking_distance(servo) * direction;
+	const float remaining = (target - servo->set_pos) * direction;
+	if (remaining >= breaking_distance) {
+		// Reachable, accelerate or cruise until braking is needed
+		servo->next_stop = target;
+		servo->positioning = ACCELERATING;
+	} else {
+		// Overshoot can not be avoided, brake at full deceleration and come back
+		servo->next_stop = servo->set_pos + breaking_distance * direction;
+		servo->positioning = BRAKING;
+		servo->brake_planned = false;
+		servo_queue_move(servo, position, servo->nominal_speed * servo->scale, 0, NULL);
+	}
+}
+
+void servo_set_backlash(servo_t* const servo, const float backlash) {
+	servo->backlash = backlash > 0.0f ? backlash / servo->scale : 0.0f;
+}
+
+float servo_get_backlash(const servo_t* const servo) {
+	return servo->backlash * servo->scale;
+}
+
+void servo_set_friction_range(servo_t* const servo, const float start, const float end, const uint16_t bins) {
+	if (servo->friction == NULL) {
+		servo->friction = friction_map_create(start / servo->scale, end / servo->scale, bins);
+	}
+}
+
+bool servo_friction_learn_start(servo_t* const servo) {
+	if (servo->friction == NULL) {
+		return false;
+	}
+	friction_map_learn_start(servo->friction);
+	servo->friction_learning = true;
+	return true;
+}
+
+bool servo_friction_learn_finish(servo_t* const servo) {
+	if (servo->friction == NULL || !servo->friction_learning) {
+		return false;
+	}
+	servo->friction_learning = false;
+	return friction_map_learn_finish(servo->friction);
+}
+
+bool servo_friction_is_learned(const servo_t* const servo) {
+	return servo->friction != NULL && friction_map_is_valid(servo->friction);
+}
+
+void servo_set_thermal_model(servo_t* const servo, const float time_constant, const float rated_duty) {
+	servo->thermal_time = time_constant;
+	servo->thermal_limit = rated_duty * rated_duty;
+}
+
+float servo_get_thermal_load(const servo_t* const servo) {
+	return servo->thermal / servo->thermal_limit;
+}
+
+float servo_get_speed_governor(const servo_t* const servo) {
+	return thermal_governor(servo);
+}
+
+float servo_get_duty(const servo_t* const servo) {
+	return (float)servo->duty / PWM_DUTY_FULL;
+}
+
+float servo_get_inertia(const servo_t* const servo) {
+	return servo->inertia;
+}
+
+bool servo_add_gain_set(servo_t* const servo, const float inertia,
+						const float pos_kp, const float pos_ki, const float pos_kd,
+						const float vel_kp, const float vel_ki, const float vel_kd) {
+	// Replace a set tuned for nearly the same inertia, otherwise insert sorted
+	uint8_t i = 0;
+	while (i < servo->gain_sets && servo->pos_sets[i].x < inertia * (1.0f - GAIN_SET_MERGE)) {
+		i++;
+	}
+	if (i == servo->gain_sets || servo->pos_sets[i].x > inertia * (1.0f + GAIN_SET_MERGE)) {
+		if (servo->gain_sets >= GAIN_SETS_MAX) {
+			return false;
+		}
+		memmove(&servo->pos_sets[i + 1], &servo->pos_sets[i], (servo->gain_sets - i) * sizeof(pid_gain_set_t));
+		memmove(&servo->vel_sets[i + 1], &servo->vel_sets[i], (servo->gain_sets - i) * sizeof(pid_gain_set_t));
+		servo->gain_sets++;
+	}
+
+	servo->pos_sets[i] = (pid_gain_set_t){inertia, pos_kp, pos_ki, pos_kd};
+	servo->vel_sets[i] = (pid_gain_set_t){inertia, vel_kp, vel_ki, vel_kd};
+	return true;
+}
+
+bool servo_store_gain_set(servo_t* const servo) {
+	if (servo->inertia <= 0.0f) {
+		servo->gain_store_pending = true;
+		return false;
+	}
+
+	float kp, ki, kd;
+	pid_get_tunings(servo->pid_pos, &kp, &ki, &kd);
+	servo->gain_store_pending = false;
+	return servo_add_gain_set(servo, servo->inertia, kp, ki, kd, servo->vel_kp, servo->vel_ki, servo->vel_kd);
+}
+
+void servo_clear_gain_schedule(servo_t* const servo) {
+	servo->gain_sets = 0;
+	servo->gain_store_pending = false;
+}
+
+void servo_enable_profile_cache(servo_t* const servo, const uint16_t blocks) {
+	if (servo->cache == NULL) {
+		servo->cache = profile_cache_create(blocks);
+	}
+}
+
 void servo_set_zero_position(servo_t* const servo) {
 	servo->set_zero = true;
 }
+
+float servo_shift_origin(servo_t* const servo, const float distance) {
+	// Whole tics only, the extended count stays exact
+	const int64_t tics = (int64_t)llroundf(distance / servo->scale * 4000.0f);
+	const float shift = (float)tics / 4000.0f;
+	servo->enc_origin += tics;
+	servo->enc_position -= shift;
+	servo->set_pos -= shift;
+	servo->next_stop -= shift;
+	servo->tune_start -= shift;
+	servo->cache_start -= shift;
+	servo->cache_target -= shift;
+	for (uint8_t i = 0; i < servo->queue_count; i++) {
+		servo->queue[(servo->queue_head + i) % MOTION_QUEUE_SIZE].position -= shift;
+	}
+	pid_shift(servo->pid_pos, shift);
+	servo->servo_position = servo->enc_position * servo->scale;
+	return shift * servo->scale;
+}
+
+int64_t servo_get_position_counts(const servo_t* const servo) {
+	return servo->enc_extended - servo->enc_origin;
+}
+
+bool servo_autotune_start(servo_t* const servo, const servo_loop_t loop, const float amplitude, const float travel) {
+	if (!*servo->enable || servo->tuning || servo->calibrating || !servo_is_idle(servo)) {
+		return false;
+	}
+
+	servo->settle_count = 0;
+	servo->tune_loop = loop;
+	servo->tune_start = servo->enc_position;
+	servo->tune_travel = travel / servo->scale;
+	if (loop == SERVO_LOOP_VELOCITY) {
+		autotune_start(servo->tuner, 0.0f, amplitude, TUNE_HYSTERESIS_VEL);
+	} else {
+		pid_reset_all(servo->pid_vel);
+		autotune_start(servo->tuner, servo->enc_position, amplitude / servo->scale, TUNE_HYSTERESIS_POS);
+	}
+	servo->tuning = true;
+	return true;
+}
+
+void servo_autotune_abort(servo_t* const servo) {
+	autotune_abort(servo->tuner);
+}
+
+autotune_state_t servo_autotune_get_state(const servo_t* const servo) {
+	return autotune_get_state(servo->tuner);
+}
+
+bool servo_autotune_get_gains(const servo_t* const servo, float* const kp, float* const ki, float* const kd) {
+	if (servo->tuning || autotune_get_state(servo->tuner) != AUTOTUNE_FINISHED) {
+		return false;
+	}
+
+	if (servo->tune_loop == SERVO_LOOP_VELOCITY) {
+		// Gains are kept per 1ms cycle
+		autotune_get_pi(servo->tuner, kp, ki);
+		*kd = 0.0f;
+	} else {
+		// Velocity loop integrates already, the position loop gets no integral
+		autotune_get_pd(servo->tuner, kp, kd);
+		*ki = 0.0f;
+	}
+	return true;
+}
+
+bool servo_autotune_apply(servo_t* const servo) {
+	float kp, ki, kd;
+	if (!servo_autotune_get_gains(servo, &kp, &ki, &kd)) {
+		return false;
+	}
+
+	if (servo->tune_loop == SERVO_LOOP_VELOCITY) {
+		servo->vel_kp = kp;
+		servo->vel_ki = ki;
+		servo->vel_kd = kd;
+		apply_velocity_gains(servo);
+	} else {
+		pid_set_tunings(servo->pid_pos, kp, ki, kd);
+	}
+	return true;
+}
+
+void servo_get_gains(const servo_t* const servo, servo_gains_t* const gains) {
+	pid_get_tunings(servo->pid_pos, &gains->pos_kp, &gains->pos_ki, &gains->pos_kd);
+	gains->vel_kp = servo->vel_kp;
+	gains->vel_ki = servo->vel_ki;
+	gains->vel_kd = servo->vel_kd;
+}
+
+void servo_set_gains(servo_t* const servo, const servo_gains_t* const gains) {
+	pid_set_tunings(servo->pid_pos, gains->pos_kp, gains->pos_ki, gains->pos_kd);
+	servo->vel_kp = gains->vel_kp;
+	servo->vel_ki = gains->vel_ki;
+	servo->vel_kd = gains->vel_kd;
+	apply_velocity_gains(servo);
+}
+
+bool servo_calibrate_output_start(servo_t* const servo, const float travel) {
+	if (!*servo->enable || servo->tuning || servo->calibrating || !servo_is_idle(servo)) {
+		return false;
+	}
+
+	servo->settle_count = 0;
+	servo->tune_start = servo->enc_position;
+	servo->tune_travel = travel / servo->scale;
+	servo->calib_state = AUTOTUNE_RUNNING;
+	servo->calib_direction = 1;
+	servo->calib_duty = 0.0f;
+	servo->calib_start = servo->enc_position;
+	servo->calib_rest = 0;
+	servo->calibrating = true;
+	return true;
+}
+
+void servo_calibrate_output_abort(servo_t* const servo) {
+	if (servo->calibrating) {
+		servo->calib_state = AUTOTUNE_FAILED;
+	}
+}
+
+autotune_state_t servo_calibrate_output_get_state(const servo_t* const servo) {
+	return servo->calib_state;
+}
+
+bool servo_calibrate_output_apply(servo_t* const servo) {
+	if (servo->calibrating || servo->calib_state != AUTOTUNE_FINISHED) {
+		return false;
+	}
+	servo_set_output_map(servo, (int)(servo->calib_result[0] * BREAKAWAY_COMPENSATION),
+		(int)(servo->calib_result[1] * BREAKAWAY_COMPENSATION));
+	return true;
+}
+
+void servo_get_breakaway(const servo_t* const servo, int* const positive, int* const negative) {
+	*positive = servo->calib_result[0];
+	*negative = servo->calib_result[1];
+}
+
+void servo_set_output_map(servo_t* const servo, const int breakaway_positive, const int breakaway_negative) {
+	servo->breakaway_pos = breakaway_positive < 0 ? 0 : (breakaway_positive > OUTPUT_LIMIT ? OUTPUT_LIMIT : breakaway_positive);
+	servo->breakaway_neg = breakaway_negative < 0 ? 0 : (breakaway_negative > OUTPUT_LIMIT ? OUTPUT_LIMIT : breakaway_negative);
+}
+
+void servo_set_pwm(servo_t* const servo, const float frequency, const uint resolution) {
+	pwm_chan_init(servo->pwm_pin, frequency, resolution);
+}
+
+float servo_autotune_get_ku(const servo_t* const servo) {
+	return autotune_get_ku(servo->tuner);
+}
+
+float servo_autotune_get_tu(const servo_t* const servo) {
+	return autotune_get_tu(servo->tuner) * CYCLE_TIME;
+}
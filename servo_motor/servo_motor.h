@@ -6,22 +6,75 @@
 #include <math.h>
 #include "hardware/timer.h"
 #include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
 #include "quadrature_encoder.pio.h"
 #include "servo_pwm.h"
 #include "../pid/PID.h"
+#include "../pid/pid_autotune.h"
+#include "friction_map.h"
+#include "profile_cache.h"
+#include "state_observer.h"
 #include "button.h"
 
 typedef struct servo_motor servo_t;
 
+/**
+ * @brief Shape of the motion profile generated for a movement
+ */
+typedef enum {
+	PROFILE_TRAPEZOIDAL,	// Acceleration switches directly between 0 and nominal value
+	PROFILE_S_CURVE			// Jerk-limited 7-segment profile, acceleration ramps up and down
+} servo_profile_t;
+
+/**
+ * @brief Control loop of the servo
+ */
+typedef enum {
+	SERVO_LOOP_VELOCITY,	// Inner loop, encoder speed to PWM
+	SERVO_LOOP_POSITION		// Outer loop, encoder position to velocity setpoint
+} servo_loop_t;
+
+/**
+ * @brief Gains of both control loops
+ */
+typedef struct {
+	float pos_kp;
+	float pos_ki;
+	float pos_kd;
+	float vel_kp;			// Velocity gains per 1ms cycle
+	float vel_ki;
+	float vel_kd;
+} servo_gains_t;
+
+/**
+ * @brief Phase of the movement, following error peaks are recorded per phase
+ */
+typedef enum {
+	SERVO_PHASE_STANDSTILL,	// Profile does not move
+	SERVO_PHASE_ACCEL,		// Speed magnitude rises
+	SERVO_PHASE_CRUISE,		// Constant speed
+	SERVO_PHASE_DECEL,		// Speed magnitude falls
+	SERVO_PHASE_COUNT
+} servo_phase_t;
+
+/**
+ * @brief Callback fired when a queued movement becomes active
+ */
+typedef void (*servo_event_t)(void);
+
 /**
  * @brief Creates and initializes a new servo motor controller
  * 
  * @param servo_name Name identifier for the servo (max 9 chars)
- * @param pio_ofset PIO program offset
- * @param sm State machine number
+ * @param pio_ofset PIO program offset of quadrature_encoder on pio0
+ * @param period_ofset PIO program offset of quadrature_period on pio1
+ * @param sm State machine number, the same on both PIO blocks
  * @param encoder_pin First encoder pin (A phase)
  * @param pwm_pin First PWM pin
  * @param scale Position scaling factor
+ * @param kvff Velocity feedforward gain, 1.0 feeds the full profile speed to the velocity loop
+ * @param kaff Acceleration feedforward gain in PWM per user unit/s^2
  * @param man_plus Manual forward button
  * @param man_minus Manual reverse button
  * @param enable Global enable signal
@@ -29,11 +82,19 @@ typedef struct servo_motor servo_t;
  * @param message Error message buffer
  * @return Initialized servo controller handle
  */
-servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int sm, 
-					const int encoder_pin, const int pwm_pin, const float scale,
+servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int period_ofset, const int sm, 
+					const int encoder_pin, const int pwm_pin, const float scale, const float kvff, const float kaff,
 					button_t *const man_plus, button_t *const man_minus, 
 					bool *const enable, bool *const error, char (*const message)[21]);
 
+/**
+ * @brief Takes a snapshot of the encoder count streamed by DMA, never waits
+ * for the PIO. Call for all servos at the start of the cycle so positions
+ * of all axes are time-aligned, then call servo_compute.
+ * @param servo Servo controller handle
+ */
+void servo_latch_encoder(servo_t* const servo);
+
 /**
  * @brief Main servo computation function, called in 1ms loop
  * @param servo Servo controller handle
@@ -41,7 +102,26 @@ servo_t* servo_create(const char servo_name[7], const int pio_ofset, const int s
 void servo_compute(servo_t* const servo);
 
 /**
- * @brief Commands servo movement with start delay
+ * @brief Sets frequency and resolution of the servo PWM, 20kHz and 1024 by
+ * default. Output duty keeps its range, only the PWM levels are scaled.
+ * @param servo Servo controller handle
+ * @param frequency PWM frequency in Hz
+ * @param resolution Counter cycles in one PWM period
+ */
+void servo_set_pwm(servo_t* const servo, const float frequency, const uint resolution);
+
+/**
+ * @brief Sets the output map which compensates the H-bridge deadzone and
+ * static friction. Breakaway duty of the direction is added to every
+ * non-zero output, the rest of the range is scaled to fit.
+ * @param servo Servo controller handle
+ * @param breakaway_positive Duty which starts the motor in positive direction, 0 to 1024
+ * @param breakaway_negative Duty which starts the motor in negative direction, 0 to 1024
+ */
+void servo_set_output_map(servo_t* const servo, const int breakaway_positive, const int breakaway_negative);
+
+/**
+ * @brief Commands servo movement with start delay, zero delay starts immediately
  * @param servo Servo controller handle
  * @param position Target position
  * @param speed Movement speed
@@ -57,6 +137,21 @@ void servo_goto_delayed(servo_t* const servo, const float position, const float
  */
 void servo_goto(servo_t* const servo, const float position, const float speed);
 
+/**
+ * @brief Commands movement of several servos which start and finish together
+ *
+ * The axis with the longest movement keeps its speed, profiles of the others
+ * are stretched in time so their speed, acceleration and jerk are lowered.
+ * 
+ * @param servos Servo controller handles
+ * @param positions Target positions
+ * @param speeds Maximum movement speeds
+ * @param count Number of servos
+ * @param delay Delay in milliseconds before the movements start, 0 for immediate start
+ */
+void servo_goto_synchronized(servo_t* const servos[], const float positions[], const float speeds[],
+							const uint8_t count, const uint32_t delay);
+
 /**
  * @brief Handles manual jog control
  * @param servo Servo controller handle
@@ -72,6 +167,30 @@ void servo_manual_handling(servo_t* const servo, const float min, const float ma
  */
 void servo_stop_positioning(servo_t* const servo);
 
+/**
+ * @brief Appends a movement to the servo motion queue
+ * 
+ * Queued movements are executed one after another. When the next movement
+ * continues in the same direction without dwell, the axis does not stop
+ * between them but passes the intermediate position at the highest speed
+ * both movements allow. servo_goto() and servo_stop_positioning() clear the queue.
+ * 
+ * @param servo Servo controller handle
+ * @param position Target position
+ * @param speed Movement speed
+ * @param dwell Delay in milliseconds before the movement starts
+ * @param event Called when the movement becomes active, before the dwell, may be NULL
+ * @return true if queued, false if the queue is full
+ */
+bool servo_queue_move(servo_t* const servo, const float position, const float speed,
+					const uint32_t dwell, servo_event_t event);
+
+/**
+ * @brief Drops all queued movements, the active movement is finished
+ * @param servo Servo controller handle
+ */
+void servo_queue_clear(servo_t* const servo);
+
 /**
  * @brief Gets the current position of the servo
  * @param servo Servo controller handle
@@ -79,6 +198,79 @@ void servo_stop_positioning(servo_t* const servo);
  */
 float servo_get_position(const servo_t* const servo);
 
+/**
+ * @brief Gets the position estimated by the state observer, encoder position
+ * refined between tics
+ * @param servo Servo controller handle
+ * @return Observed position in user units
+ */
+float servo_get_observed_position(const servo_t* const servo);
+
+/**
+ * @brief Gets the speed estimated by the state observer, feedback of the velocity loop
+ * @param servo Servo controller handle
+ * @return Observed speed in user units per s
+ */
+float servo_get_speed(const servo_t* const servo);
+
+/**
+ * @brief Gets the acceleration estimated by the state observer
+ * @param servo Servo controller handle
+ * @return Observed acceleration in user units per s^2
+ */
+float servo_get_acceleration(const servo_t* const servo);
+
+/**
+ * @brief Sets the bandwidth of the state observer. Higher bandwidth follows
+ * fast changes of speed with less lag, lower bandwidth filters more of the
+ * encoder quantization. Once the inertia is estimated, the output is fed
+ * into the observer as known acceleration.
+ * @param servo Servo controller handle
+ * @param bandwidth Bandwidth in rad/s, default 400
+ */
+void servo_set_observer_bandwidth(servo_t* const servo, const float bandwidth);
+
+/**
+ * @brief Gets the tracking error of the last cycle, profile position minus
+ * encoder position. Zero while the servo is disabled.
+ * @param servo Servo controller handle
+ * @return Following error in user units
+ */
+float servo_get_following_error(const servo_t* const servo);
+
+/**
+ * @brief Sets the following error envelope. Error is allowed up to
+ * static_limit + per_speed * |speed| + per_acc * |acceleration| of the profile.
+ * Default is 1 rev at standstill, 0.02 s and 0.002 s^2.
+ * @param servo Servo controller handle
+ * @param static_limit Allowed error at standstill in user units
+ * @param per_speed Allowance per unit of speed in seconds
+ * @param per_acc Allowance per unit of acceleration in seconds squared
+ */
+void servo_set_following_error_limits(servo_t* const servo, const float static_limit,
+									const float per_speed, const float per_acc);
+
+/**
+ * @brief Gets the following error allowed in the last cycle
+ * @param servo Servo controller handle
+ * @return Envelope of the following error in user units
+ */
+float servo_get_following_error_limit(const servo_t* const servo);
+
+/**
+ * @brief Gets the peak following error of a phase over the last movements
+ * @param servo Servo controller handle
+ * @param phase Movement phase
+ * @return Peak of absolute following error in user units
+ */
+float servo_get_following_error_peak(const servo_t* const servo, const servo_phase_t phase);
+
+/**
+ * @brief Clears the recorded following error peaks
+ * @param servo Servo controller handle
+ */
+void servo_clear_following_error_peaks(servo_t* const servo);
+
 /**
  * @brief Gets a pointer to the servo's position variable
  * @param servo Servo controller handle
@@ -89,10 +281,37 @@ float* servo_get_position_pointer(servo_t* const servo);
 /**
  * @brief Checks if servo is in idle state
  * @param servo Servo controller handle
- * @return true if servo is idle, false otherwise
+ * @return true if servo is idle and no movement is queued, false otherwise
  */
 bool servo_is_idle(const servo_t* const servo);
 
+/**
+ * @brief Checks if an output of the control loops was limited in the last
+ * cycle. Short saturation is allowed, only a lasting one raises PID Error.
+ * @param servo Servo controller handle
+ * @return true if position or velocity loop is saturated
+ */
+bool servo_is_saturated(const servo_t* const servo);
+
+/**
+ * @brief Checks if servo is in position. The profile has to be finished and
+ * the encoder has to stay within the window with speed under the threshold
+ * for the configured number of cycles. A movement which does not settle
+ * within 2s after its profile finished raises the machine error.
+ * @param servo Servo controller handle
+ * @return true if servo is settled at its stop position, false otherwise
+ */
+bool servo_is_settled(const servo_t* const servo);
+
+/**
+ * @brief Sets the in-position window used by servo_is_settled()
+ * @param servo Servo controller handle
+ * @param window Allowed distance from the stop position in user units
+ * @param speed Allowed speed in user units per second
+ * @param ticks Consecutive cycles the servo has to stay within the limits
+ */
+void servo_set_settle_window(servo_t* const servo, const float window, const float speed, const uint16_t ticks);
+
 /**
  * @brief Checks if servo is in acceleration phase
  * @param servo Servo controller handle
@@ -109,6 +328,14 @@ bool servo_is_position_reached(const servo_t* const servo);
 
 bool servo_is_speed_reached(const servo_t* const servo);
 
+/**
+ * @brief Selects the motion profile used for following movements
+ * @param servo Servo controller handle
+ * @param profile Profile shape
+ * @param jerk Jerk limit in user units per s^3, used by PROFILE_S_CURVE only
+ */
+void servo_set_profile(servo_t* const servo, const servo_profile_t profile, const float jerk);
+
 /**
  * @brief Sets the target stop position without starting movement
  * @param servo Servo controller handle
@@ -116,6 +343,144 @@ bool servo_is_speed_reached(const servo_t* const servo);
  */
 void servo_set_stop_position(servo_t* const servo, const float position);
 
+/**
+ * @brief Moves the stop position of a moving servo and replans the profile
+ * from its current speed and acceleration. When the new position is closer
+ * than the braking distance, the servo brakes at full deceleration and
+ * returns to it. A standing servo simply moves to the new position.
+ * Queued movements are dropped. Calling it with the same position again
+ * keeps the plan.
+ * @param servo Servo controller handle
+ * @param position New stop position in user units
+ */
+void servo_retarget(servo_t* const servo, const float position);
+
+/**
+ * @brief Sets the backlash between motor and load. After a reversal of the
+ * commanded movement the motor is driven ahead by the lash, ramped in with
+ * limited speed and acceleration. Reported position is the load position.
+ * @param servo Servo controller handle
+ * @param backlash Lash in user units, 0 disables the compensation
+ */
+void servo_set_backlash(servo_t* const servo, const float backlash);
+
+/**
+ * @brief Gets the compensated backlash
+ * @param servo Servo controller handle
+ * @return Lash in user units
+ */
+float servo_get_backlash(const servo_t* const servo);
+
+/**
+ * @brief Creates the friction map of the servo, it is empty until learned.
+ * Further calls keep the existing map.
+ * @param servo Servo controller handle
+ * @param start One end of the mapped range in user units
+ * @param end Other end of the mapped range in user units
+ * @param bins Number of position bins
+ */
+void servo_set_friction_range(servo_t* const servo, const float start, const float end, const uint16_t bins);
+
+/**
+ * @brief Starts learning the friction map. Feedforward from the map is off
+ * and the controller effort is recorded while the servo cruises, the range
+ * should be traversed at constant speed in both directions.
+ * @param servo Servo controller handle
+ * @return false if the servo has no friction map
+ */
+bool servo_friction_learn_start(servo_t* const servo);
+
+/**
+ * @brief Finishes learning, the map is fed forward to PWM when enough of
+ * the range was traversed in both directions
+ * @param servo Servo controller handle
+ * @return true if the map was learned
+ */
+bool servo_friction_learn_finish(servo_t* const servo);
+
+bool servo_friction_is_learned(const servo_t* const servo);
+
+/**
+ * @brief Sets the thermal model of motor and driver. Square of the PWM duty
+ * stands in for the heating current and is filtered with the time constant.
+ * Close to the limit, new movements are slowed down, well above it the
+ * servo stops with an error.
+ * @param servo Servo controller handle
+ * @param time_constant Thermal time constant in s, 30 by default
+ * @param rated_duty Duty the drive can take continuously, 0.5 by default
+ */
+void servo_set_thermal_model(servo_t* const servo, const float time_constant, const float rated_duty);
+
+/**
+ * @brief Gets the state of the thermal model
+ * @param servo Servo controller handle
+ * @return Heat relative to the limit, 1 at the limit
+ */
+float servo_get_thermal_load(const servo_t* const servo);
+
+/**
+ * @brief Gets the factor new movements are slowed down by, acceleration
+ * is scaled by its square
+ * @param servo Servo controller handle
+ * @return Speed factor, 1 while the drive is cool
+ */
+float servo_get_speed_governor(const servo_t* const servo);
+
+/**
+ * @brief Gets the PWM duty of the last cycle
+ * @param servo Servo controller handle
+ * @return Duty relative to full PWM, -1 to 1
+ */
+float servo_get_duty(const servo_t* const servo);
+
+/**
+ * @brief Gets the inertia estimated from the accelerating phases of movements
+ * @param servo Servo controller handle
+ * @return Inertia in PWM per rev/s^2, 0 before the first estimate
+ */
+float servo_get_inertia(const servo_t* const servo);
+
+/**
+ * @brief Adds a set of gains to the schedule. When movements update the
+ * inertia estimate, gains of both loops are interpolated between the sets
+ * around it. A set within 10% of the inertia of another one replaces it.
+ * @param servo Servo controller handle
+ * @param inertia Inertia the gains are tuned for, PWM per rev/s^2
+ * @param pos_kp Position loop gains
+ * @param pos_ki
+ * @param pos_kd
+ * @param vel_kp Velocity loop gains per 1ms cycle
+ * @param vel_ki
+ * @param vel_kd
+ * @return false if the schedule is full
+ */
+bool servo_add_gain_set(servo_t* const servo, const float inertia,
+						const float pos_kp, const float pos_ki, const float pos_kd,
+						const float vel_kp, const float vel_ki, const float vel_kd);
+
+/**
+ * @brief Adds the current gains to the schedule at the estimated inertia.
+ * Without an estimate yet, they are added with the first one.
+ * @param servo Servo controller handle
+ * @return true if added now
+ */
+bool servo_store_gain_set(servo_t* const servo);
+
+/**
+ * @brief Removes all gain sets, gains are then left as they are
+ * @param servo Servo controller handle
+ */
+void servo_clear_gain_schedule(servo_t* const servo);
+
+/**
+ * @brief Enables the profile cache. Setpoints of a movement from standstill
+ * to standstill are recorded on its first run, later movements with the same
+ * start, stop, speed and limits replay them. Further calls keep the cache.
+ * @param servo Servo controller handle
+ * @param blocks Size of the cache in blocks of 256 cycles, 512 bytes each
+ */
+void servo_enable_profile_cache(servo_t* const servo, const uint16_t blocks);
+
 /**
  * @brief Sets current position as zero reference
  * @param servo Servo controller handle
@@ -124,5 +489,134 @@ void servo_set_stop_position(servo_t* const servo, const float position);
  */
 void servo_set_zero_position(servo_t* const servo);
 
+/**
+ * @brief Moves the position zero by the distance, rounded to whole encoder
+ * tics. Positions of the profile, the queue and the encoder are shifted
+ * together, so the movement in progress is not disturbed. Moving the origin
+ * along with the job keeps positions small and precise on unbounded axes.
+ * @param servo Servo controller handle
+ * @param distance Distance to move the origin in user units
+ * @return Distance actually moved, stored positions have to be shifted by it
+ */
+float servo_shift_origin(servo_t* const servo, const float distance);
+
+/**
+ * @brief Gets the encoder position as a whole count from the origin
+ * @param servo Servo controller handle
+ * @return Encoder tics from the position zero
+ */
+int64_t servo_get_position_counts(const servo_t* const servo);
+
+/**
+ * @brief Starts relay auto-tuning of one control loop
+ *
+ * Velocity loop is driven by the relay on PWM, position loop by the relay
+ * on the velocity setpoint, so the velocity loop should be tuned first.
+ * The servo oscillates around its current position.
+ *
+ * @param servo Servo controller handle
+ * @param loop Loop to be tuned
+ * @param amplitude Relay amplitude, PWM for velocity loop, user units/s for position loop
+ * @param travel Experiment is aborted when the servo gets further from the start position, user units
+ * @return false if the servo is not enabled and idle
+ */
+bool servo_autotune_start(servo_t* const servo, const servo_loop_t loop, const float amplitude, const float travel);
+
+/**
+ * @brief Stops the running experiment, the servo holds its position
+ * @param servo Servo controller handle
+ */
+void servo_autotune_abort(servo_t* const servo);
+
+/**
+ * @brief Gets the state of the last experiment
+ * @param servo Servo controller handle
+ * @return AUTOTUNE_RUNNING while in progress, AUTOTUNE_FINISHED or AUTOTUNE_FAILED when done
+ */
+autotune_state_t servo_autotune_get_state(const servo_t* const servo);
+
+/**
+ * @brief Gets the gains the finished experiment proposes for the tuned loop,
+ * Ziegler-Nichols PI for velocity loop and PD for position loop
+ * @param servo Servo controller handle
+ * @param kp Proportional gain
+ * @param ki Integral gain, velocity gains are per 1ms cycle
+ * @param kd Derivative gain
+ * @return false if there is no result
+ */
+bool servo_autotune_get_gains(const servo_t* const servo, float* const kp, float* const ki, float* const kd);
+
+/**
+ * @brief Applies gains of the finished experiment to the tuned loop,
+ * the ones given by servo_autotune_get_gains
+ * @param servo Servo controller handle
+ * @return false if there is no result to apply
+ */
+bool servo_autotune_apply(servo_t* const servo);
+
+/**
+ * @brief Gets the gains of both loops
+ * @param servo Servo controller handle
+ * @param gains Gains, velocity ones per 1ms cycle
+ */
+void servo_get_gains(const servo_t* const servo, servo_gains_t* const gains);
+
+/**
+ * @brief Sets the gains of both loops, for example to restore them after
+ * a rejected tuning
+ * @param servo Servo controller handle
+ * @param gains Gains, velocity ones per 1ms cycle
+ */
+void servo_set_gains(servo_t* const servo, const servo_gains_t* const gains);
+
+/**
+ * @brief Starts the breakaway calibration. Duty is ramped up slowly in
+ * positive and then in negative direction until the axis starts to move.
+ * The servo has to be enabled and idle.
+ * @param servo Servo controller handle
+ * @param travel Permitted travel from the start position in user units
+ * @return true if started
+ */
+bool servo_calibrate_output_start(servo_t* const servo, const float travel);
+
+/**
+ * @brief Stops the breakaway calibration, its state becomes AUTOTUNE_FAILED
+ * @param servo Servo controller handle
+ */
+void servo_calibrate_output_abort(servo_t* const servo);
+
+/**
+ * @brief Gets the state of the breakaway calibration
+ * @param servo Servo controller handle
+ * @return State of the calibration
+ */
+autotune_state_t servo_calibrate_output_get_state(const servo_t* const servo);
+
+/**
+ * @brief Sets the output map from the finished calibration, part of the
+ * measured breakaway duty is compensated
+ * @param servo Servo controller handle
+ * @return true if applied, false if no calibration has finished
+ */
+bool servo_calibrate_output_apply(servo_t* const servo);
+
+/**
+ * @brief Gets the breakaway duty measured by the last calibration
+ * @param servo Servo controller handle
+ * @param positive Duty in positive direction
+ * @param negative Duty in negative direction
+ */
+void servo_get_breakaway(const servo_t* const servo, int* const positive, int* const negative);
+
+/**
+ * @brief Ultimate gain of the last finished experiment
+ */
+float servo_autotune_get_ku(const servo_t* const servo);
+
+/**
+ * @brief Ultimate period of the last finished experiment in seconds
+ */
+float servo_autotune_get_tu(const servo_t* const servo);
+
 #endif
  
\ No newline at end of file
@@ -1,32 +1,41 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
+#include "hardware/clocks.h"
 
 #include "servo_pwm.h"
 
 
-uint pwm_chan_init(uint gpio_pin_num){
+uint pwm_chan_init(uint gpio_pin_num, float frequency, uint resolution){
     gpio_set_function(gpio_pin_num, GPIO_FUNC_PWM);
     gpio_set_function(gpio_pin_num + 1, GPIO_FUNC_PWM);
 
     // Find out which PWM slice is connected to GPIO # (it's slice #)
     uint slice_num = pwm_gpio_to_slice_num(gpio_pin_num);
-    pwm_set_clkdiv(slice_num, gpio_pin_num); // PWM clock divider
-    pwm_set_wrap(slice_num, 1023);  // Set period of 1024 cycles (0 to 1023 inclusive)
+
+    // Counter wraps after resolution cycles, the divider sets the frequency.
+    // Divider is 8.4 fixed point, from 1 to 255 15/16
+    resolution = resolution < 2 ? 2 : (resolution > 65536 ? 65536 : resolution);
+    float divider = (float)clock_get_hz(clk_sys) / (frequency * (float)resolution);
+    divider = divider < 1.0f ? 1.0f : (divider > 255.9375f ? 255.9375f : divider);
+    pwm_set_clkdiv(slice_num, divider);
+    pwm_set_wrap(slice_num, resolution - 1);
     pwm_set_enabled(slice_num, true);
     return slice_num;
 }
 
 void set_two_chans_pwm(uint slice_num, int speed){
+    // Duty is given in 1/PWM_DUTY_FULL, scaled to the resolution of the slice
+    const uint32_t period = pwm_hw->slice[slice_num].top + 1;
     if (speed >= 0)
     {
-        pwm_set_chan_level(slice_num, PWM_CHAN_A, speed);
+        pwm_set_chan_level(slice_num, PWM_CHAN_A, (uint16_t)(((uint32_t)speed * period) / PWM_DUTY_FULL));
         pwm_set_chan_level(slice_num, PWM_CHAN_B, 0); 
     }
     else
     {
         pwm_set_chan_level(slice_num, PWM_CHAN_A, 0);
-        pwm_set_chan_level(slice_num, PWM_CHAN_B, -speed);
+        pwm_set_chan_level(slice_num, PWM_CHAN_B, (uint16_t)(((uint32_t)-speed * period) / PWM_DUTY_FULL));
     }
 }
 
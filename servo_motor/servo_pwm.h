@@ -5,15 +5,19 @@
 extern "C" {
 #endif
 
+#define PWM_DUTY_FULL 1024	// Duty of set_two_chans_pwm at full PWM, independent of resolution
+
 	/**
 		 * @brief Initializing the pwm module
 		 *
 		 * Will set the pwm chanel of desired GPIO Pin
 		 * @param gpio_pin_num GPIO Pin number
+		 * @param frequency PWM frequency in Hz
+		 * @param resolution Counter cycles in one PWM period, 2 to 65536
 		 * 
 		 * @return Slice number of pwm module
 		 */
-	uint pwm_chan_init(uint gpio_pin_num);
+	uint pwm_chan_init(uint gpio_pin_num, float frequency, uint resolution);
 
 	/**
 		 * @brief The BTS7960 H-Bridge DC motor module 
@@ -23,7 +27,8 @@ extern "C" {
 		 * to desired GPIO 
 		 * @param pwm_slice_1 PWM Pin number - Will set the pwm value 
 		 * to desired GPIO
-		 * @param speed PWM Speed - it can be a positive or negative number
+		 * @param speed PWM Speed - it can be a positive or negative number,
+		 * PWM_DUTY_FULL is full duty at any resolution
 		 * 
 		 * @return void
 		 */
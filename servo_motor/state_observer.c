@@ -0,0 +1,70 @@
+#include "state_observer.h"
+#include <stdlib.h>
+#include <math.h>
+
+struct state_observer {
+	float period;
+	float alpha;		// Correction of position, velocity and disturbance per unit of residual
+	float beta;
+	float gamma;
+	float input_gain;
+
+	float offset;		// Estimated minus measured position
+	float velocity;
+	float disturbance;	// Acceleration not explained by the input
+	float acceleration;
+};
+
+state_observer_t* observer_create(const float period, const float bandwidth) {
+	state_observer_t* observer = calloc(1, sizeof(struct state_observer));
+	observer_set_bandwidth(observer, period, bandwidth);
+	return observer;
+}
+
+void observer_set_bandwidth(state_observer_t* const observer, const float period, const float bandwidth) {
+	// All poles of the error dynamics at theta, the discrete image of -bandwidth
+	const float theta = expf(-bandwidth * period);
+	const float rest = 1.0f - theta;
+	observer->period = period;
+	observer->alpha = 1.0f - theta * theta * theta;
+	observer->beta = 1.5f * rest * rest * (1.0f + theta) / period;
+	observer->gamma = rest * rest * rest / (period * period);
+}
+
+void observer_set_input_gain(state_observer_t* const observer, const float gain) {
+	observer->input_gain = gain;
+}
+
+void observer_reset(state_observer_t* const observer) {
+	observer->offset = 0.0f;
+	observer->velocity = 0.0f;
+	observer->disturbance = 0.0f;
+	observer->acceleration = 0.0f;
+}
+
+void observer_update(state_observer_t* const observer, const float movement, const float input) {
+	// Prediction, the measured movement is taken out of the offset at once
+	const float t = observer->period;
+	const float acc = observer->disturbance + observer->input_gain * input;
+	observer->offset += observer->velocity * t + acc * t * t / 2.0f - movement;
+	observer->velocity += acc * t;
+
+	// Correction by the residual, measured minus predicted position
+	const float residual = -observer->offset;
+	observer->offset += observer->alpha * residual;
+	observer->velocity += observer->beta * residual;
+	observer->disturbance += observer->gamma * residual;
+	observer->acceleration = observer->disturbance + observer->input_gain * input;
+}
+
+float observer_get_offset(const state_observer_t* const observer) {
+	return observer->offset;
+}
+
+float observer_get_velocity(const state_observer_t* const observer) {
+	return observer->velocity;
+}
+
+float observer_get_acceleration(const state_observer_t* const observer) {
+	return observer->acceleration;
+}
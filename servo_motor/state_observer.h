@@ -0,0 +1,67 @@
+#ifndef STATE_OBSERVER_H
+#define STATE_OBSERVER_H
+
+/**
+ * Observer of position, velocity and acceleration of an axis driven through
+ * a double integrator. Measured position corrects the prediction with gains
+ * which place all three poles at the bandwidth (critically damped alpha-beta-
+ * gamma filter). The commanded effort can be fed in as a known acceleration,
+ * the third state then only carries the acceleration it does not explain,
+ * friction and load. Position is kept relative to the measurement, so the
+ * estimate keeps full resolution however far the axis travels.
+ */
+typedef struct state_observer state_observer_t;
+
+/**
+ * @brief Creates an observer at rest
+ *
+ * @param period Time between updates in s
+ * @param bandwidth Bandwidth of the estimate in rad/s
+ *
+ * @return returns a state_observer_t* observer handle
+ */
+state_observer_t* observer_create(const float period, const float bandwidth);
+
+/**
+ * @brief Changes update period and bandwidth, the estimate is kept
+ *
+ * @param observer The observer instance
+ * @param period Time between updates in s
+ * @param bandwidth Bandwidth of the estimate in rad/s
+ */
+void observer_set_bandwidth(state_observer_t* const observer, const float period, const float bandwidth);
+
+/**
+ * @brief Sets the acceleration caused by a unit of input, 0 ignores the input
+ *
+ * @param observer The observer instance
+ * @param gain Acceleration per unit of input
+ */
+void observer_set_input_gain(state_observer_t* const observer, const float gain);
+
+/**
+ * @brief Axis at rest at the measured position
+ * @param observer The observer instance
+ */
+void observer_reset(state_observer_t* const observer);
+
+/**
+ * @brief Predicts the state for the next update and corrects it with the measurement
+ *
+ * @param observer The observer instance
+ * @param movement Measured change of position since the last update
+ * @param input Input applied since the last update
+ */
+void observer_update(state_observer_t* const observer, const float movement, const float input);
+
+/**
+ * @brief Estimated position minus measured position
+ * @param observer The observer instance
+ */
+float observer_get_offset(const state_observer_t* const observer);
+
+float observer_get_velocity(const state_observer_t* const observer);
+
+float observer_get_acceleration(const state_observer_t* const observer);
+
+#endif
@@ -11,6 +11,14 @@
 #include "servo_motor/servo_motor.h"
 #include "servo_motor/button.h"
 
+#ifdef PROFILE_CONTROL_LOOP
+#include "hardware/structs/systick.h"
+
+// Processor cycles spent in machine_compute()
+volatile uint32_t control_cycles_last;
+volatile uint32_t control_cycles_max;
+#endif
+
 // Timers
 struct repeating_timer servo_timer;
 struct repeating_timer LCD_refresh_timer;
@@ -51,17 +59,38 @@ void core1_entry() {
                 i++;
             } else {
                 i = 0;
-                const uint16_t* history = get_reflectivity_history();
+                const reflectivity_view_t history = get_reflectivity_history();
                 for (uint16_t j = 0; j < 200; j++) {
-                    printf("%u%s", history[j], (j < 199) ? "," : "\n");
+                    const uint16_t value = j < history.newest_length ? history.newest[j]
+                                                                     : history.oldest[j - history.newest_length];
+                    printf("%u%s", value, (j < 199) ? "," : "\n");
                 }
+#ifdef PRINT_THERMAL_STATE
+                printf("thermal: %.2f %.2f governor: %.2f %.2f\n",
+                       servo_get_thermal_load(devices.servo_cutter), servo_get_thermal_load(devices.servo_feeder),
+                       servo_get_speed_governor(devices.servo_cutter), servo_get_speed_governor(devices.servo_feeder));
+#endif
+#ifdef PROFILE_CONTROL_LOOP
+                printf("cycles: %lu max: %lu\n", (unsigned long)control_cycles_last, (unsigned long)control_cycles_max);
+#endif
             }   
         }
     }
 }
 
 bool servo_timer_callback(struct repeating_timer *t) {
+#ifdef PROFILE_CONTROL_LOOP
+    // SysTick counts down from 0xFFFFFF, longest loop is well below the wrap
+    const uint32_t start = systick_hw->cvr;
     machine_compute();
+    const uint32_t cycles = (start - systick_hw->cvr) & 0x00FFFFFF;
+    control_cycles_last = cycles;
+    if (cycles > control_cycles_max) {
+        control_cycles_max = cycles;
+    }
+#else
+    machine_compute();
+#endif
     return true;
 }
 
@@ -76,6 +105,13 @@ int main() {
     // Initialize
     stdio_init_all();
 
+#ifdef PROFILE_CONTROL_LOOP
+    // SysTick free running from processor clock, the timer callback runs on core0
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+#endif
+
     // Timer for servo control
     add_repeating_timer_ms(-1, servo_timer_callback, NULL, &servo_timer);
 
@@ -0,0 +1,13 @@
+#ifndef HARDWARE_ADC_H
+#define HARDWARE_ADC_H
+
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint16_t adc_read(void);
+
+#endif
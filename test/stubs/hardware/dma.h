@@ -0,0 +1,13 @@
+#ifndef HARDWARE_DMA_H
+#define HARDWARE_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+int dma_claim_unused_channel(bool required);
+int dma_claim_unused_timer(bool required);
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HARDWARE_GPIO_H
+#define HARDWARE_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+enum gpio_function {
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7
+};
+
+#define GPIO_IN 0
+#define GPIO_OUT 1
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+
+#endif
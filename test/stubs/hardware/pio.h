@@ -0,0 +1,30 @@
+#ifndef HARDWARE_PIO_H
+#define HARDWARE_PIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico.h"
+
+typedef unsigned int uint;
+
+typedef struct {
+    volatile uint32_t txf[4];
+    volatile uint32_t rxf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t *pio0_hw;
+extern pio_hw_t *pio1_hw;
+#define pio0 pio0_hw
+#define pio1 pio1_hw
+
+typedef struct {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HARDWARE_TIMER_H
+#define HARDWARE_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+#endif
@@ -0,0 +1,118 @@
+#include <stddef.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/pwm.h"
+#include "quadrature_encoder.pio.h"
+#include "host_sdk.h"
+
+static pio_hw_t host_pio0;
+static pio_hw_t host_pio1;
+pio_hw_t *pio0_hw = &host_pio0;
+pio_hw_t *pio1_hw = &host_pio1;
+pwm_hw_t host_pwm_hw;
+
+const pio_program_t quadrature_encoder_program;
+const pio_program_t quadrature_period_program;
+
+static volatile int32_t *encoder_count[HOST_STATE_MACHINES];
+static uint32_t period_fifo[HOST_STATE_MACHINES][HOST_PERIOD_FIFO];
+static uint8_t period_level[HOST_STATE_MACHINES];
+static uint16_t pwm_level[8][2];
+static const uint16_t *adc_samples;
+static uint32_t adc_count;
+static uint32_t adc_index;
+static int dma_channels;
+static uint64_t time_us;
+
+// Time
+uint64_t time_us_64(void) { return time_us; }
+uint32_t time_us_32(void) { return (uint32_t)time_us; }
+void sleep_ms(uint32_t ms) { time_us += (uint64_t)ms * 1000; }
+
+// GPIO
+void gpio_init(uint gpio) {}
+void gpio_set_dir(uint gpio, bool out) {}
+void gpio_put(uint gpio, bool value) {}
+bool gpio_get(uint gpio) { return false; }
+void gpio_pull_up(uint gpio) {}
+void gpio_set_function(uint gpio, enum gpio_function fn) {}
+
+// Clocks
+uint32_t clock_get_hz(enum clock_index clk_index) { return 125000000; }
+
+// PIO and DMA
+uint pio_add_program(PIO pio, const pio_program_t *program) { return 0; }
+int dma_claim_unused_channel(bool required) { return dma_channels++; }
+int dma_claim_unused_timer(bool required) { return 0; }
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator) {}
+
+// PWM, slices as on RP2040, two GPIOs per slice
+uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+void pwm_set_clkdiv(uint slice_num, float divider) { host_pwm_hw.slice[slice_num].div = (uint32_t)(divider * 16.0f); }
+void pwm_set_wrap(uint slice_num, uint16_t wrap) { host_pwm_hw.slice[slice_num].top = wrap; }
+void pwm_set_enabled(uint slice_num, bool enabled) {}
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level) { pwm_level[slice_num][chan] = level; }
+
+// ADC
+void adc_init(void) {}
+void adc_gpio_init(uint gpio) {}
+void adc_select_input(uint input) {}
+
+uint16_t adc_read(void) {
+    if (adc_samples == NULL || adc_count == 0) {
+        return 0;
+    }
+    const uint16_t sample = adc_samples[adc_index];
+    if (adc_index + 1 < adc_count) {
+        adc_index++;
+    }
+    return sample;
+}
+
+// Encoder program, the count is streamed by DMA and edge periods are queued
+void quadrature_encoder_program_init(PIO pio, uint sm, uint offset, uint pin, int max_step_rate) {}
+
+void quadrature_encoder_dma_init(PIO pio, uint sm, uint tx_dma, uint rx_dma, uint timer, volatile int32_t *count) {
+    encoder_count[sm] = count;
+}
+
+void quadrature_encoder_dma_restart(uint tx_dma, uint rx_dma) {}
+void quadrature_period_program_init(PIO pio, uint sm, uint offset, uint pin) {}
+
+bool quadrature_period_fetch(PIO pio, uint sm, uint32_t *loops) {
+    if (pio != pio1 || period_level[sm] == 0) {
+        return false;
+    }
+    *loops = period_fifo[sm][0];
+    period_level[sm]--;
+    for (uint8_t i = 0; i < period_level[sm]; i++) {
+        period_fifo[sm][i] = period_fifo[sm][i + 1];
+    }
+    return true;
+}
+
+// Test side
+void host_encoder_set(const unsigned int sm, const int32_t count) {
+    if (encoder_count[sm] != NULL) {
+        *encoder_count[sm] = count;
+    }
+}
+
+void host_period_push(const unsigned int sm, const uint32_t loops) {
+    if (period_level[sm] < HOST_PERIOD_FIFO) {
+        period_fifo[sm][period_level[sm]++] = loops;
+    }
+}
+
+int host_pwm_duty(const unsigned int slice) {
+    return (int)pwm_level[slice][PWM_CHAN_A] - (int)pwm_level[slice][PWM_CHAN_B];
+}
+
+void host_adc_set(const uint16_t* samples, const uint32_t count) {
+    adc_samples = samples;
+    adc_count = count;
+    adc_index = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef HOST_SDK_H
+#define HOST_SDK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HOST_STATE_MACHINES 4
+#define HOST_PERIOD_FIFO 8		// Joined RX FIFO of the period program
+
+/**
+ * @brief Sets the count the DMA streams from the encoder state machine
+ * @param sm State machine number given to servo_create
+ * @param count Quadrature count, wraps like the 32-bit state machine counter
+ */
+void host_encoder_set(const unsigned int sm, const int32_t count);
+
+/**
+ * @brief Pushes an edge period to the period state machine, dropped when full
+ * @param sm State machine number given to servo_create
+ * @param loops Period in loops of the period program
+ */
+void host_period_push(const unsigned int sm, const uint32_t loops);
+
+/**
+ * @brief Gets the duty last written to the H-bridge of the slice
+ * @param slice PWM slice
+ * @return Level of channel A minus level of channel B
+ */
+int host_pwm_duty(const unsigned int slice);
+
+/**
+ * @brief Sets the samples returned by adc_read(), one per call
+ * @param samples Samples, NULL makes adc_read() return 0
+ * @param count Number of samples, the last one repeats
+ */
+void host_adc_set(const uint16_t* samples, const uint32_t count);
+
+#endif
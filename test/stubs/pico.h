@@ -0,0 +1,8 @@
+#ifndef PICO_H
+#define PICO_H
+
+// Host stand-in of the Pico SDK, only what the tested sources use
+
+static inline void tight_loop_contents(void) {}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef PICO_STDLIB_H
+#define PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "pico.h"
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+
+void sleep_ms(uint32_t ms);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef QUADRATURE_ENCODER_PIO_H
+#define QUADRATURE_ENCODER_PIO_H
+
+// Host stand-in of the header pico_generate_pio_header() makes from
+// quadrature_encoder.pio. Counts and edge periods come from host_sdk.h.
+
+#include "hardware/pio.h"
+
+// one loop of the waiting code takes 2 cycles of the state machine clock
+#define QUADRATURE_PERIOD_LOOP_CYCLES 2
+
+extern const pio_program_t quadrature_encoder_program;
+extern const pio_program_t quadrature_period_program;
+
+void quadrature_encoder_program_init(PIO pio, uint sm, uint offset, uint pin, int max_step_rate);
+void quadrature_encoder_dma_init(PIO pio, uint sm, uint tx_dma, uint rx_dma, uint timer, volatile int32_t *count);
+void quadrature_encoder_dma_restart(uint tx_dma, uint rx_dma);
+void quadrature_period_program_init(PIO pio, uint sm, uint offset, uint pin);
+bool quadrature_period_fetch(PIO pio, uint sm, uint32_t *loops);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <math.h>
+
+// Checks of the host tests, a failed check is printed and the test goes on
+
+static int test_failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) do { \
+    const double check_value = (value); \
+    const double check_expected = (expected); \
+    if (!(fabs(check_value - check_expected) <= (tolerance))) { \
+        printf("%s:%d: CHECK_NEAR(%s, %s) failed, %g is not within %g of %g\n", __FILE__, __LINE__, \
+            #value, #expected, check_value, (double)(tolerance), check_expected); \
+        test_failures++; \
+    } \
+} while (0)
+
+/**
+ * @brief Prints the result of the test
+ * @return Exit code of the test, 0 when all checks passed
+ */
+static int test_result(void) {
+    if (test_failures > 0) {
+        printf("%d checks failed\n", test_failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TEST_AXIS_H
+#define TEST_AXIS_H
+
+// Axis driven by a servo, included after servo_motor.c as it reads the
+// servo structure. The motor tracks the profile without following error,
+// at the next latch it stands where the profile is planned to be then. The
+// profile can be checked without a motor model in the way. Rising edges of phase A are
+// timed as the period program would time them. A load may hang on the motor
+// with lash, the motor drags it along once the lash is taken up.
+
+#include <string.h>
+#include "host_sdk.h"
+
+#define AXIS_LOOPS_PER_CYCLE 62500.0	// Period program loops in one 1ms cycle at 125MHz
+
+typedef struct {
+	servo_t* servo;
+	bool enable;
+	bool error;
+	char message[21];
+	int64_t motor;			// Motor position in extended tics
+	int64_t disturbance;	// Tics the motor stays away from the commanded position
+	double edge_time;		// Cycle of the last rising edge of phase A
+	uint32_t cycle;
+	double lash;			// Lash between motor and load in tics
+	double load;			// Load position in tics
+} test_axis_t;
+
+/**
+ * Creates the servo of the axis with the feedforward of the machine,
+ * sm selects the state machine and the pins
+ */
+static void axis_init(test_axis_t* const axis, const char name[7], const int sm, const float scale) {
+	memset(axis, 0, sizeof(*axis));
+	axis->enable = true;
+	axis->servo = servo_create(name, 0, 0, sm, 6 + 2 * sm, 18 + 2 * sm, scale, 1.0f, 0.05f,
+		NULL, NULL, &axis->enable, &axis->error, &axis->message);
+}
+
+/**
+ * Moves the motor evenly over one cycle, every fourth tic is a rising edge
+ */
+static void axis_move_motor(test_axis_t* const axis, const int64_t target) {
+	const int64_t from = axis->motor;
+	const int64_t step = target > from ? 1 : -1;
+	for (int64_t tic = from; tic != target; ) {
+		tic += step;
+		if (tic % 4 == 0) {
+			const double time = axis->cycle + (double)(tic - from) / (double)(target - from);
+			host_period_push(axis->servo->sm, (uint32_t)((time - axis->edge_time) * AXIS_LOOPS_PER_CYCLE));
+			axis->edge_time = time;
+		}
+	}
+	axis->motor = target;
+
+	const double half_lash = axis->lash / 2.0;
+	if (axis->load < (double)axis->motor - half_lash) {
+		axis->load = (double)axis->motor - half_lash;
+	} else if (axis->load > (double)axis->motor + half_lash) {
+		axis->load = (double)axis->motor + half_lash;
+	}
+}
+
+/**
+ * One 1ms cycle, the servo computes and the motor moves to its command
+ */
+static void axis_cycle(test_axis_t* const axis) {
+	servo_t* const servo = axis->servo;
+	servo_latch_encoder(servo);
+	servo_compute(servo);
+	if (*servo->enable) {
+		const double next_pos = (double)servo->set_pos + (double)servo->computed_speed * CYCLE_TIME;
+		axis_move_motor(axis, servo->enc_origin + axis->disturbance +
+			llround((next_pos + (double)servo->backlash_offset) * 4000.0));
+	}
+	host_encoder_set(servo->sm, (int32_t)(uint32_t)axis->motor);
+	axis->cycle++;
+}
+
+/**
+ * Runs cycles until the servo settles, at most the given number.
+ * Returns the cycles run.
+ */
+static uint32_t axis_run_settled(test_axis_t* const axis, const uint32_t cycles) {
+	uint32_t i = 0;
+	do {
+		axis_cycle(axis);
+		i++;
+	} while (i < cycles && !servo_is_settled(axis->servo));
+	return i;
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Backlash compensation of servo_motor.c: the motor is driven ahead of the
+// load by half of the lash in the direction of movement, so the load lands
+// on the target from both sides. The offset is ramped with limited speed
+// and acceleration.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_FEEDER 6.4f
+#define JERK_FEEDER 12800.0f
+#define LASH 0.32f					// 200 tics of the feeder
+#define LASH_TICS 200.0
+#define TICS_PER_MM (4000.0 / SCALE_FEEDER)
+
+typedef struct {
+	float max_offset;		// Largest backlash offset in rev
+	float max_speed;		// Largest rate of the offset in rev/s
+	float max_acc;			// Largest change of the rate in rev/s^2
+} backlash_stats_t;
+
+/**
+ * Moves the axis until it settles, returns the landing error of the load in tics
+ */
+static double run_move(test_axis_t* const axis, const float position, backlash_stats_t* const stats) {
+	servo_t* const servo = axis->servo;
+	float previous_speed = servo->backlash_speed;
+	servo_goto(servo, position, 100.0f);
+	for (uint32_t i = 0; i < 5000; i++) {
+		axis_cycle(axis);
+		stats->max_offset = fmaxf(stats->max_offset, fabsf(servo->backlash_offset));
+		stats->max_speed = fmaxf(stats->max_speed, fabsf(servo->backlash_speed));
+		stats->max_acc = fmaxf(stats->max_acc, fabsf(servo->backlash_speed - previous_speed) / CYCLE_TIME);
+		previous_speed = servo->backlash_speed;
+		if (servo_is_settled(servo)) {
+			break;
+		}
+	}
+	return axis->load - (double)servo->enc_origin - position * TICS_PER_MM;
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Feeder", 1, SCALE_FEEDER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_FEEDER);
+	axis.lash = LASH_TICS;
+	backlash_stats_t stats = {0.0f, 0.0f, 0.0f};
+
+	// Compensated, the load lands on the target from both sides and the
+	// reported position is the load position
+	servo_set_backlash(servo, LASH);
+	CHECK_NEAR(servo_get_backlash(servo), LASH, 1e-6f);
+	CHECK_NEAR(run_move(&axis, 50.0f, &stats), 0.0, 1.0);
+	CHECK_NEAR(servo_get_position(servo), 50.0f, 1e-3f);
+	CHECK_NEAR(run_move(&axis, 20.0f, &stats), 0.0, 1.0);
+	CHECK_NEAR(servo_get_position(servo), 20.0f, 1e-3f);
+	CHECK_NEAR(run_move(&axis, 40.0f, &stats), 0.0, 1.0);
+	CHECK_NEAR(run_move(&axis, 39.0f, &stats), 0.0, 1.0);
+
+	// Offset stays within half of the lash and is ramped within its limits
+	CHECK(stats.max_offset <= LASH / SCALE_FEEDER / 2.0f * 1.0001f);
+	CHECK(stats.max_speed <= BACKLASH_SPEED * 1.0001f);
+	// The cycle landing on the half lash may take one more step of the rate
+	CHECK(stats.max_acc <= 2.0f * BACKLASH_ACC * 1.001f);
+	CHECK(!axis.error);
+
+	// Without compensation the load lands half of the lash behind the motor,
+	// the two sides differ by the lash
+	servo_set_backlash(servo, 0.0f);
+	run_move(&axis, 30.0f, &stats);
+	CHECK(servo->backlash_offset == 0.0f);
+	const double forward = run_move(&axis, 45.0f, &stats);
+	const double backward = run_move(&axis, 20.0f, &stats);
+	CHECK_NEAR(forward, -LASH_TICS / 2.0, 1.0);
+	CHECK_NEAR(backward - forward, LASH_TICS, 1.0);
+	CHECK(!axis.error);
+
+	return test_result();
+}
@@ -0,0 +1,69 @@
+// History of mark_detector.c: the ring buffers read like the shifted arrays
+// they replace, newest sample first, and the view hands out the same history
+// in two spans. Stored positions follow the moves of the feeder origin.
+
+#include <stdlib.h>
+#include "../machine/mark_detector.c"
+#include "test.h"
+#include "host_sdk.h"
+
+#define SAMPLES 2000
+#define RESOLUTION (6.4f / 4000.0f)		// Feeder travel of one encoder count in mm
+
+static uint16_t samples[SAMPLES];
+
+int main(void) {
+	// Noisy reflectivity with a few deep dips
+	srand(1);
+	for (int i = 0; i < SAMPLES; i++) {
+		samples[i] = (uint16_t)(2800 + rand() % 200 - (i % 300 < 20 ? 1500 : 0));
+	}
+	host_adc_set(samples, SAMPLES);
+
+	float feeder = 0.0f;
+	bool error = false;
+	char message[21];
+	init_detector(0, &feeder, RESOLUTION, &error, &message);
+
+	// Shifted arrays as the detector kept them before, with the same moving average
+	uint16_t history[MEM_SIZE] = {0};
+	float positions[MEM_SIZE] = {0};
+	moving_average_filter_t filter;
+	init_moving_average_filter(&filter);
+
+	int32_t count = 0;
+	bool same_history = true, same_view = true, same_positions = true;
+	for (int i = 0; i < SAMPLES; i++) {
+		count += 9 + i % 3;
+		feeder = (float)count * RESOLUTION;
+		if (i % 700 == 699) {
+			detector_shift_positions(feeder);
+			for (int j = 0; j < MEM_SIZE; j++) {
+				positions[j] -= feeder;
+			}
+			count = 0;
+			feeder = 0.0f;
+		}
+
+		detector_compute();
+		memmove(&history[1], &history[0], (MEM_SIZE - 1) * sizeof(uint16_t));
+		memmove(&positions[1], &positions[0], (MEM_SIZE - 1) * sizeof(float));
+		history[0] = moving_average_compute(&filter, samples[i]);
+		positions[0] = feeder;
+
+		const reflectivity_view_t view = get_reflectivity_history();
+		same_view = same_view && view.newest_length + view.oldest_length == MEM_SIZE;
+		for (int age = 0; age < MEM_SIZE; age++) {
+			same_history = same_history && reflectivity_at(age) == history[age];
+			const uint16_t viewed = age < view.newest_length ?
+				view.newest[age] : view.oldest[age - view.newest_length];
+			same_view = same_view && viewed == history[age];
+			same_positions = same_positions && fabsf(position_at(age) - positions[age]) <= RESOLUTION / 2.0f;
+		}
+	}
+	CHECK(same_history);
+	CHECK(same_view);
+	CHECK(same_positions);
+
+	return test_result();
+}
@@ -0,0 +1,200 @@
+// Replay of recorded reflectivity through mark_detector.c. The streaming
+// minimum and the spike checks must decide like full scans of the history
+// did, at every sample of the captures and of synthetic marks of varying
+// depth and width. Arguments are the captures, every line a dump of the
+// history newest first.
+
+#include <stdlib.h>
+#include "../machine/mark_detector.c"
+#include "test.h"
+#include "host_sdk.h"
+
+#define MAX_SAMPLES 1200000
+#define SYNTHETIC_MARKS 3000
+#define RESOLUTION (6.4f / 4000.0f)		// Feeder travel of one encoder count in mm
+
+static uint16_t samples[MAX_SAMPLES];
+static uint32_t sample_count;
+
+typedef struct {
+	uint32_t tick;
+	float position;		// In mm
+} mark_t;
+
+// Marks the detector found in data.txt, data_2.txt and data_3.txt before
+// the minimum was streamed, with the history shifted by memmove
+static const mark_t capture_marks[] = {
+	{2699, 41.1984f},
+	{23721, 377.5504f},
+	{52459, 37.3616f},
+};
+#define CAPTURE_MARKS (sizeof(capture_marks) / sizeof(capture_marks[0]))
+
+static mark_t found[SYNTHETIC_MARKS];
+
+// History as it was kept before, shifted arrays with the newest sample first
+static struct {
+	uint16_t history[MEM_SIZE];
+	float positions[MEM_SIZE];
+	moving_average_filter_t filter;
+	float mark_position;
+} reference;
+
+/**
+ * Appends the captures, every line is replayed oldest sample first
+ */
+static bool load_capture(const char* const path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		printf("%s: cannot open\n", path);
+		return false;
+	}
+	char line[8192];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		uint16_t dump[MEM_SIZE * 2];
+		int length = 0;
+		for (char* token = strtok(line, ",\r\n"); token != NULL && length < MEM_SIZE * 2; token = strtok(NULL, ",\r\n")) {
+			dump[length++] = (uint16_t)atoi(token);
+		}
+		for (int i = length - 1; i >= 0 && sample_count < MAX_SAMPLES; i--) {
+			samples[sample_count++] = dump[i];
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+/**
+ * Random numbers of a fixed sequence on every host
+ */
+static uint32_t random_next(void) {
+	static uint32_t state = 7;
+	state = state * 1103515245u + 12345u;
+	return (state >> 16) & 0x7FFF;
+}
+
+/**
+ * Appends marks of varying depth and width on a noisy baseline
+ */
+static void add_synthetic_marks(void) {
+	for (int mark = 0; mark < SYNTHETIC_MARKS; mark++) {
+		const int base = 2500 + random_next() % 800;
+		const int depth = random_next() % 600;
+		const int width = 2 + random_next() % 80;
+		const int gap = 50 + random_next() % 400;
+		for (int i = 0; i < gap && sample_count < MAX_SAMPLES; i++) {
+			samples[sample_count++] = (uint16_t)(base + random_next() % 40 - 20);
+		}
+		for (int i = 0; i < width && sample_count < MAX_SAMPLES; i++) {
+			const double dip = depth * sin(M_PI * (i + 1) / (width + 1));
+			samples[sample_count++] = (uint16_t)(base - (int)dip + (int)(random_next() % 40) - 20);
+		}
+	}
+}
+
+/**
+ * Detection of the shifted arrays with full scans for the minimum and the area
+ */
+static bool reference_detect_mark(const uint16_t long_term_average) {
+	uint16_t minimum = UINT16_MAX, index_of_minimum = 0;
+	for (uint16_t i = 0; i < MEM_SIZE; i++) {
+		if (reference.history[i] < minimum) {
+			minimum = reference.history[i];
+			index_of_minimum = i;
+		}
+	}
+	const uint16_t tolerance_line = long_term_average - BELLOW_AVG_MIN;
+	if (index_of_minimum != MEM_SIZE / 2 || minimum > long_term_average - BELLOW_AVG_MIN ||
+		reference.history[0] < tolerance_line || reference.history[MEM_SIZE - 1] < tolerance_line) {
+		return false;
+	}
+	uint32_t area = 0;
+	for (int i = 0; i < MEM_SIZE; i++) {
+		area += reference.history[i] < tolerance_line ? tolerance_line - reference.history[i] : 0;
+	}
+	if (area < MIN_SPIKE_AREA || area > MAX_SPIKE_AREA) {
+		return false;
+	}
+	reference.mark_position = reference.positions[index_of_minimum];
+	return true;
+}
+
+/**
+ * Replays the samples from first to last, the feeder runs at about 15mm/s,
+ * its origin moves and the detector restarts now and then. Returns the
+ * number of marks found, the first of them are kept in found.
+ */
+static uint32_t replay(const uint32_t first, const uint32_t last, uint32_t* const differences) {
+	float feeder = 0.0f;
+	bool error = false;
+	char message[21];
+	host_adc_set(&samples[first], last - first);
+	init_detector(0, &feeder, RESOLUTION, &error, &message);
+	memset(&reference, 0, sizeof(reference));
+	init_moving_average_filter(&reference.filter);
+
+	int32_t count = 0;
+	uint32_t marks = 0;
+	for (uint32_t tick = 0; tick < last - first; tick++) {
+		count += 9 + tick % 3;
+		feeder = (float)count * RESOLUTION;
+		if (tick % 50000 == 49999) {
+			detector_shift_positions(feeder);
+			for (int i = 0; i < MEM_SIZE; i++) {
+				reference.positions[i] -= feeder;
+			}
+			count = 0;
+			feeder = 0.0f;
+		}
+
+		detector_compute();
+		memmove(&reference.history[1], &reference.history[0], (MEM_SIZE - 1) * sizeof(uint16_t));
+		memmove(&reference.positions[1], &reference.positions[0], (MEM_SIZE - 1) * sizeof(float));
+		reference.history[0] = moving_average_compute(&reference.filter, samples[first + tick]);
+		reference.positions[0] = feeder;
+		if (tick % 7000 == 0) {
+			detector_restart();
+		}
+
+		if (is_sampling_done()) {
+			const bool expected = reference_detect_mark(detector.long_term_average);
+			const bool detected = detect_mark();
+			if (detected != expected ||
+				(detected && fabsf(get_mark_position() - reference.mark_position) > RESOLUTION / 2.0f)) {
+				(*differences)++;
+			}
+			if (detected && marks < SYNTHETIC_MARKS) {
+				found[marks] = (mark_t){tick, get_mark_position()};
+			}
+			marks += detected ? 1 : 0;
+		}
+	}
+	return marks;
+}
+
+int main(int argc, char** argv) {
+	CHECK(argc > 1);
+	for (int i = 1; i < argc; i++) {
+		CHECK(load_capture(argv[i]));
+	}
+	const uint32_t captured = sample_count;
+	add_synthetic_marks();
+	CHECK(sample_count < MAX_SAMPLES);
+
+	// Captures alone find the marks they found before
+	uint32_t differences = 0;
+	CHECK(replay(0, captured, &differences) == CAPTURE_MARKS);
+	CHECK(differences == 0);
+	for (uint32_t i = 0; i < CAPTURE_MARKS; i++) {
+		CHECK(found[i].tick == capture_marks[i].tick);
+		CHECK_NEAR(found[i].position, capture_marks[i].position, 1e-3f);
+	}
+
+	// Synthetic marks, the ones deep and wide enough are found
+	differences = 0;
+	const uint32_t marks = replay(captured, sample_count, &differences);
+	CHECK(marks > SYNTHETIC_MARKS / 20);
+	CHECK(differences == 0);
+
+	return test_result();
+}
@@ -0,0 +1,86 @@
+// friction_map.c: effort is averaged per bin and direction, gaps take the
+// learned bin next to them, only the deviation from the average of the range is
+// kept and it is interpolated between bin centers.
+
+#include "friction_map.h"
+#include "test.h"
+
+#define BINS 10
+#define BIN_WIDTH 10.0f
+
+/**
+ * Positive direction is 100 with a tight spot of 20 more in bin 3,
+ * negative direction falls from -100 to -110 along the range
+ */
+static float effort(const float position, const float speed) {
+	if (speed > 0.0f) {
+		return position >= 30.0f && position < 40.0f ? 120.0f : 100.0f;
+	}
+	return -100.0f - floorf(position / BIN_WIDTH);
+}
+
+/**
+ * Traverses bins first to last with the given samples per bin and direction
+ */
+static void traverse(friction_map_t* const map, const uint16_t first, const uint16_t last, const int samples) {
+	for (uint16_t bin = first; bin <= last; bin++) {
+		for (int i = 0; i < samples; i++) {
+			const float position = (bin + (i + 0.5f) / samples) * BIN_WIDTH;
+			friction_map_learn(map, position, 1.0f, effort(position, 1.0f));
+			friction_map_learn(map, position, -1.0f, effort(position, -1.0f));
+		}
+	}
+}
+
+int main(void) {
+	friction_map_t* const map = friction_map_create(0.0f, BINS * BIN_WIDTH, BINS);
+	CHECK(!friction_map_is_valid(map));
+	CHECK(friction_map_get(map, 35.0f, 1.0f) == 0.0f);
+
+	// Full traverse, only the deviation from the average is kept
+	friction_map_learn_start(map);
+	traverse(map, 0, BINS - 1, 20);
+	friction_map_learn(map, 150.0f, 1.0f, 1000.0f);
+	friction_map_learn(map, -5.0f, -1.0f, 1000.0f);
+	CHECK(friction_map_learn_finish(map));
+	CHECK(friction_map_is_valid(map));
+	CHECK_NEAR(friction_map_get(map, 35.0f, 1.0f), 18.0f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 75.0f, 1.0f), -2.0f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 5.0f, -1.0f), 4.5f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 95.0f, -1.0f), -4.5f, 1e-4f);
+	CHECK(friction_map_get(map, 35.0f, 0.0f) == 0.0f);
+
+	// Interpolated between bin centers, clamped at the ends of the range
+	CHECK_NEAR(friction_map_get(map, 40.0f, 1.0f), 8.0f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 50.0f, -1.0f), 0.0f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, -20.0f, -1.0f), 4.5f, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 200.0f, -1.0f), -4.5f, 1e-4f);
+
+	// Bins with too few samples are gaps, they take the learned bin below,
+	// the ones at the start the first learned bin
+	friction_map_learn_start(map);
+	CHECK(!friction_map_is_valid(map));
+	traverse(map, 2, 7, 20);
+	traverse(map, 8, 8, 9);
+	traverse(map, 9, 9, 20);
+	CHECK(friction_map_learn_finish(map));
+	const float average = (-102.0f * 3 - 103.0f - 104.0f - 105.0f - 106.0f - 107.0f * 2 - 109.0f) / BINS;
+	CHECK_NEAR(friction_map_get(map, 5.0f, -1.0f), -102.0f - average, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 15.0f, -1.0f), -102.0f - average, 1e-4f);
+	CHECK_NEAR(friction_map_get(map, 85.0f, -1.0f), -107.0f - average, 1e-4f);
+
+	// Too few learned bins leave the map invalid, nothing is fed forward
+	friction_map_learn_start(map);
+	traverse(map, 0, 3, 20);
+	CHECK(!friction_map_learn_finish(map));
+	CHECK(friction_map_get(map, 35.0f, 1.0f) == 0.0f);
+
+	// Range may be given from its upper end
+	friction_map_t* const reversed = friction_map_create(BINS * BIN_WIDTH, 0.0f, BINS);
+	friction_map_learn_start(reversed);
+	traverse(reversed, 0, BINS - 1, 20);
+	CHECK(friction_map_learn_finish(reversed));
+	CHECK_NEAR(friction_map_get(reversed, 35.0f, 1.0f), 18.0f, 1e-4f);
+
+	return test_result();
+}
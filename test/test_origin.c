@@ -0,0 +1,87 @@
+// Extended position of servo_motor.c: the 32-bit state machine count is
+// extended to 64 bits across its wrap, positions are whole tics from the
+// origin and servo_shift_origin moves the origin without disturbing a move.
+
+#include <stdint.h>
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_FEEDER 6.4f
+#define JERK_FEEDER 12800.0f
+#define SPEED_FEEDER 100.0f
+#define STRIP 50.0f				// 50mm is 31250 tics of the feeder
+#define STRIP_TICS 31250
+
+/**
+ * Runs a move and returns the largest step of the motor in one cycle
+ */
+static int64_t run_move(test_axis_t* const axis, const float position,
+						const uint32_t shift_after, const float shift, float* const shifted) {
+	servo_t* const servo = axis->servo;
+	int64_t max_step = 0;
+	servo_goto(servo, position, SPEED_FEEDER);
+	for (uint32_t i = 0; i < 5000; i++) {
+		if (i == shift_after) {
+			*shifted = servo_shift_origin(servo, shift);
+		}
+		const int64_t previous = axis->motor;
+		axis_cycle(axis);
+		max_step = axis->motor - previous > max_step ? axis->motor - previous : max_step;
+		if (servo_is_settled(servo)) {
+			break;
+		}
+	}
+	return max_step;
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Feeder", 1, SCALE_FEEDER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_FEEDER);
+	// The motor does not follow the duty, the long run must not trip the thermal model
+	servo_set_thermal_model(servo, THERMAL_TIME, 1.0f);
+	float shifted = 0.0f;
+
+	// Zero just below the wrap of the state machine count
+	const int64_t start = INT32_MAX - 20000;
+	axis.motor = start;
+	host_encoder_set(servo->sm, (int32_t)start);
+	servo_set_zero_position(servo);
+	axis_run_settled(&axis, 100);
+	CHECK(servo_get_position_counts(servo) == 0);
+	CHECK_NEAR(servo_get_position(servo), 0.0f, 1e-6f);
+
+	// The strip crosses the wrap, the count stays exact
+	run_move(&axis, STRIP, UINT32_MAX, 0.0f, &shifted);
+	CHECK(axis.motor > INT32_MAX);
+	CHECK(servo_get_position_counts(servo) == STRIP_TICS);
+	CHECK_NEAR(servo_get_position(servo), STRIP, 1e-5f);
+
+	// The job moves the origin to every stop, the strips do not drift
+	for (int strip = 2; strip <= 200; strip++) {
+		shifted = servo_shift_origin(servo, servo_get_position(servo));
+		CHECK_NEAR(shifted, STRIP, 1e-5f);
+		CHECK(servo_get_position_counts(servo) == 0);
+		run_move(&axis, STRIP, UINT32_MAX, 0.0f, &shifted);
+		CHECK(servo_get_position_counts(servo) == STRIP_TICS);
+	}
+	CHECK(axis.motor == start + 200 * (int64_t)STRIP_TICS);
+	CHECK(!axis.error);
+
+	// Shift during a move is rounded to whole tics and does not disturb it,
+	// the motor lands on the same tic and the position is shifted by it
+	servo_shift_origin(servo, servo_get_position(servo));
+	const int64_t before = axis.motor;
+	const int64_t max_step = run_move(&axis, STRIP, 200, 20.001f, &shifted);
+	const float shifted_tics = shifted / SCALE_FEEDER * 4000.0f;
+	CHECK_NEAR(shifted_tics, 12501.0f, 1e-3f);
+	CHECK(axis.motor == before + STRIP_TICS);
+	CHECK(servo_get_position_counts(servo) == STRIP_TICS - 12501);
+	CHECK_NEAR(servo_get_position(servo), STRIP - shifted, 1e-4f);
+	CHECK(max_step <= (int64_t)(SPEED_FEEDER / SCALE_FEEDER * 4000.0f * CYCLE_TIME) + 1);
+	CHECK(!axis.error);
+
+	return test_result();
+}
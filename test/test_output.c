@@ -0,0 +1,78 @@
+// Output stage of servo_motor.c: controller duty is mapped past the breakaway
+// duty of each direction, ramped in inside the deadband, and scaled to the
+// counter resolution of the PWM slice at any frequency.
+
+#include "../servo_motor/servo_motor.c"
+#include "hardware/pwm.h"
+#include "test.h"
+#include "test_axis.h"
+
+/**
+ * Duty written to the H-bridge for the controller duty
+ */
+static int output(servo_t* const servo, const int duty) {
+	servo_output(servo, duty);
+	return host_pwm_duty(servo->pwm_slice);
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Cutter", 0, 20.0f);
+	servo_t* const servo = axis.servo;
+	const uint slice = servo->pwm_slice;
+
+	// Defaults, 20kHz with 1024 counter cycles, duty passes unchanged
+	CHECK(pwm_hw->slice[slice].top == PWM_RESOLUTION - 1);
+	CHECK(pwm_hw->slice[slice].div == (uint32_t)(125e6f / (PWM_FREQUENCY * PWM_RESOLUTION) * 16.0f));
+	CHECK(output(servo, 0) == 0);
+	CHECK(output(servo, 1) == 1);
+	CHECK(output(servo, 512) == 512);
+	CHECK(output(servo, -512) == -512);
+	CHECK(output(servo, 5000) == 1024);
+	CHECK(output(servo, -5000) == -1024);
+	CHECK(servo->output == -OUTPUT_LIMIT);
+
+	// Full clock at 20kHz gives 6250 counter cycles, duty is scaled to them
+	servo_set_pwm(servo, 20000.0f, 6250);
+	CHECK(pwm_hw->slice[slice].top == 6249);
+	CHECK(pwm_hw->slice[slice].div == 16);
+	CHECK(output(servo, 512) == 3125);
+	CHECK(output(servo, -1024) == -6250);
+	CHECK(output(servo, 1) == 6);
+
+	// Divider is limited to its 8.4 fixed point range, resolution to the counter
+	servo_set_pwm(servo, 10.0f, 1024);
+	CHECK(pwm_hw->slice[slice].div == 255 * 16 + 15);
+	servo_set_pwm(servo, 20000.0f, 100000);
+	CHECK(pwm_hw->slice[slice].top == 65535);
+	servo_set_pwm(servo, PWM_FREQUENCY, PWM_RESOLUTION);
+
+	// Breakaway of each direction is added, full duty stays full
+	servo_set_output_map(servo, 200, 150);
+	CHECK(output(servo, 0) == 0);
+	CHECK(output(servo, OUTPUT_DEADBAND) == 200 + OUTPUT_DEADBAND * 824 / 1024);
+	CHECK(output(servo, -OUTPUT_DEADBAND) == -(150 + OUTPUT_DEADBAND * 874 / 1024));
+	CHECK(output(servo, 512) == 200 + 412);
+	CHECK(output(servo, 1024) == 1024);
+	CHECK(output(servo, -1024) == -1024);
+
+	// Ramp inside the deadband meets the map at its edge, the map is monotonic
+	int previous = output(servo, -OUTPUT_LIMIT);
+	bool monotonic = true;
+	for (int duty = -OUTPUT_LIMIT + 1; duty <= OUTPUT_LIMIT; duty++) {
+		const int mapped = output(servo, duty);
+		monotonic = monotonic && mapped >= previous;
+		previous = mapped;
+	}
+	CHECK(monotonic);
+	CHECK(output(servo, OUTPUT_DEADBAND - 1) < output(servo, OUTPUT_DEADBAND));
+	CHECK(output(servo, OUTPUT_DEADBAND - 1) > output(servo, OUTPUT_DEADBAND) * (OUTPUT_DEADBAND - 2) / OUTPUT_DEADBAND);
+
+	// Breakaway is limited to the output range
+	servo_set_output_map(servo, -5, 2000);
+	CHECK(servo->breakaway_pos == 0);
+	CHECK(servo->breakaway_neg == OUTPUT_LIMIT);
+	CHECK(output(servo, -OUTPUT_DEADBAND) == -OUTPUT_LIMIT);
+
+	return test_result();
+}
@@ -0,0 +1,121 @@
+// Profile cache of servo_motor.c: a movement from standstill to standstill
+// is recorded on its first run and replayed on the next identical one. The
+// replay follows the computed profile and lands on the target, a change of
+// plan during the replay continues from the replayed state.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_CUTTER 20.0f
+#define JERK_CUTTER 40000.0f
+#define MAX_CYCLES 5000
+#define POSITION_TOLERANCE 0.00001f	// Float rounding of positions in rev, 1/25 tic
+#define ACC_TOLERANCE 4.0f			// Rounding of positions around 5 rev to float and to the cache, in rev/s^2
+
+typedef struct {
+	float set_pos[MAX_CYCLES];	// Profile position of every cycle in rev
+	float acc[MAX_CYCLES];		// Profile acceleration of every cycle in rev/s^2
+	uint32_t cycles;			// Cycles until the profile reached its position
+	uint32_t replayed;			// Cycles replayed from the cache
+	float max_jerk;				// Largest change of acceleration after the retarget in rev/s^3
+} trace_t;
+
+/**
+ * Moves the axis, retargets it after the given cycles, and traces the
+ * profile until the axis settles
+ */
+static void run_move(test_axis_t* const axis, const float position, const uint32_t retarget_after,
+					const float target, trace_t* const trace) {
+	servo_t* const servo = axis->servo;
+	float previous_acc = 0.0f;
+	memset(trace, 0, sizeof(*trace));
+	servo_goto(servo, position, 250.0f);
+	for (uint32_t i = 0; i < MAX_CYCLES; i++) {
+		if (i == retarget_after) {
+			servo_retarget(servo, target);
+		}
+		axis_cycle(axis);
+		trace->set_pos[i] = servo->set_pos;
+		trace->acc[i] = servo->computed_acc;
+		if (servo->positioning == ACCELERATING || servo->positioning == BRAKING) {
+			trace->cycles = i + 1;
+		}
+		if (servo->cache_mode == CACHE_REPLAY) {
+			trace->replayed++;
+		}
+		if (i > retarget_after) {
+			trace->max_jerk = fmaxf(trace->max_jerk, fabsf(servo->computed_acc - previous_acc) / CYCLE_TIME);
+		}
+		previous_acc = servo->computed_acc;
+		if (servo_is_settled(servo)) {
+			break;
+		}
+	}
+}
+
+/**
+ * Largest difference of the positions of two traces in rev
+ */
+static float trace_difference(const trace_t* const a, const trace_t* const b) {
+	float difference = 0.0f;
+	for (uint32_t i = 0; i < a->cycles && i < b->cycles; i++) {
+		difference = fmaxf(difference, fabsf(a->set_pos[i] - b->set_pos[i]));
+	}
+	return difference;
+}
+
+/**
+ * Largest difference of the accelerations of two traces in rev/s^2
+ */
+static float trace_acc_difference(const trace_t* const a, const trace_t* const b) {
+	float difference = 0.0f;
+	for (uint32_t i = 0; i < a->cycles && i < b->cycles; i++) {
+		difference = fmaxf(difference, fabsf(a->acc[i] - b->acc[i]));
+	}
+	return difference;
+}
+
+static trace_t fresh, recorded, replayed, back, aborted;
+
+int main(void) {
+	test_axis_t axis, reference;
+	axis_init(&axis, "Cutter", 0, SCALE_CUTTER);
+	axis_init(&reference, "Cutter", 1, SCALE_CUTTER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_CUTTER);
+	servo_set_profile(reference.servo, PROFILE_S_CURVE, JERK_CUTTER);
+	servo_enable_profile_cache(servo, 16);
+
+	// Recording does not change the profile
+	run_move(&reference, 100.0f, UINT32_MAX, 0.0f, &fresh);
+	run_move(&axis, 100.0f, UINT32_MAX, 0.0f, &recorded);
+	CHECK(recorded.replayed == 0);
+	CHECK(recorded.cycles == fresh.cycles);
+	CHECK(trace_difference(&recorded, &fresh) == 0.0f);
+
+	// The identical movement is replayed, it follows the recording and lands on the target
+	run_move(&axis, 0.0f, UINT32_MAX, 0.0f, &back);
+	CHECK(back.replayed == 0);
+	run_move(&axis, 100.0f, UINT32_MAX, 0.0f, &replayed);
+	CHECK(replayed.replayed > 0);
+	CHECK(replayed.replayed + 1 >= replayed.cycles);
+	CHECK(replayed.cycles == recorded.cycles);
+	CHECK(trace_difference(&replayed, &recorded) <= POSITION_TOLERANCE);
+	CHECK(trace_acc_difference(&replayed, &recorded) <= ACC_TOLERANCE);
+	CHECK_NEAR(servo->set_pos, 100.0f / SCALE_CUTTER, POSITION_TOLERANCE);
+	CHECK(!axis.error);
+
+	// Retarget during the replay drops it, the axis brakes from the replayed state
+	run_move(&axis, 0.0f, UINT32_MAX, 0.0f, &back);
+	CHECK(back.replayed > 0);
+	run_move(&axis, 100.0f, 150, 60.0f, &aborted);
+	CHECK(aborted.replayed >= 140 && aborted.replayed <= 151);
+	CHECK(trace_difference(&aborted, &recorded) > POSITION_TOLERANCE);
+	CHECK(servo->cache_mode == CACHE_OFF);
+	CHECK_NEAR(servo->set_pos, 60.0f / SCALE_CUTTER, POSITION_TOLERANCE);
+	CHECK(aborted.max_jerk <= servo->nominal_jerk * 1.001f);
+	CHECK(!axis.error);
+
+	return test_result();
+}
@@ -0,0 +1,128 @@
+// Motion queue of servo_motor.c: legs in the same direction blend without
+// stopping and keep the limits, reversals and dwells stop on the leg end.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_CUTTER 20.0f
+#define JERK_CUTTER 40000.0f
+#define LIMIT_TOLERANCE 1.001f		// Float rounding of the limits
+#define POSITION_TOLERANCE 0.00001f	// Float rounding of positions in rev, 1/25 tic
+
+static int events[4];
+static int event_count;
+
+static void event_first(void) { events[event_count++] = 1; }
+static void event_second(void) { events[event_count++] = 2; }
+static void event_third(void) { events[event_count++] = 3; }
+
+typedef struct {
+	float min_speed;	// Lowest speed magnitude from reaching the cruise speed to the last leg, in rev/s
+	float max_acc;		// Profile magnitudes in rev/s^2 and rev/s^3
+	float max_jerk;
+	float max_pos;		// Furthest position in rev
+	float min_pos;
+	float backstep;		// Furthest step against the given direction in rev
+	uint32_t cycles;	// Cycles until the axis settled
+	uint32_t stopped;	// Cycles waiting for a leg to start after the first one
+} queue_stats_t;
+
+/**
+ * Runs the queued legs until the axis settles, direction is the one of the
+ * first leg and cruise the speed it reaches in rev/s
+ */
+static queue_stats_t run_queue(test_axis_t* const axis, const float direction, const float cruise) {
+	servo_t* const servo = axis->servo;
+	queue_stats_t stats = {INFINITY, 0.0f, 0.0f, servo->set_pos, servo->set_pos, 0.0f, 0, 0};
+	float previous_pos = servo->set_pos;
+	float previous_acc = 0.0f;
+	bool started = false;
+	bool cruising = false;
+
+	while (stats.cycles < 20000 && !servo_is_settled(servo)) {
+		axis_cycle(axis);
+		stats.cycles++;
+		const float speed = fabsf(servo->computed_speed);
+		cruising = cruising || speed >= cruise / LIMIT_TOLERANCE;
+		if (cruising && servo->queue_count > 0) {
+			stats.min_speed = fminf(stats.min_speed, speed);
+		}
+		if (started && servo->positioning == REQUESTED) {
+			stats.stopped++;
+		}
+		started = started || speed > 0.0f;
+		stats.max_acc = fmaxf(stats.max_acc, fabsf(servo->computed_acc));
+		stats.max_jerk = fmaxf(stats.max_jerk, fabsf(servo->computed_acc - previous_acc) / CYCLE_TIME);
+		stats.max_pos = fmaxf(stats.max_pos, servo->set_pos);
+		stats.min_pos = fminf(stats.min_pos, servo->set_pos);
+		stats.backstep = fmaxf(stats.backstep, (previous_pos - servo->set_pos) * direction);
+		previous_pos = servo->set_pos;
+		previous_acc = servo->computed_acc;
+	}
+	return stats;
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Cutter", 0, SCALE_CUTTER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_CUTTER);
+	const float speed = 250.0f / SCALE_CUTTER;
+
+	// Three legs in one direction pass the leg ends at speed, in order
+	CHECK(servo_queue_move(servo, 100.0f, 250.0f, 0, event_first));
+	CHECK(servo_queue_move(servo, 200.0f, 250.0f, 0, event_second));
+	CHECK(servo_queue_move(servo, 300.0f, 250.0f, 0, event_third));
+	queue_stats_t stats = run_queue(&axis, 1.0f, speed);
+	CHECK(servo_is_settled(servo));
+	CHECK_NEAR(servo_get_position(servo), 300.0f, SCALE_CUTTER / 4000.0f);
+	CHECK(event_count == 3 && events[0] == 1 && events[1] == 2 && events[2] == 3);
+	CHECK(stats.min_speed >= speed / LIMIT_TOLERANCE);
+	CHECK(stats.max_acc <= servo->nominal_acc * LIMIT_TOLERANCE);
+	CHECK(stats.max_jerk <= servo->nominal_jerk * LIMIT_TOLERANCE);
+	CHECK(stats.max_pos <= 300.0f / SCALE_CUTTER + POSITION_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+
+	// Blended legs take as long as one move over the whole length
+	const float time = profile_time(300.0f / SCALE_CUTTER, speed, servo->nominal_acc, servo->nominal_jerk, PROFILE_S_CURVE);
+	CHECK(stats.cycles * CYCLE_TIME < time + 0.1f);
+
+	// Slower second leg, the first one brakes to its speed before the leg end
+	CHECK(servo_queue_move(servo, 250.0f, 250.0f, 0, NULL));
+	CHECK(servo_queue_move(servo, 150.0f, 50.0f, 0, NULL));
+	stats = run_queue(&axis, -1.0f, speed);
+	CHECK_NEAR(servo_get_position(servo), 150.0f, SCALE_CUTTER / 4000.0f);
+	CHECK(stats.min_speed >= 50.0f / SCALE_CUTTER / LIMIT_TOLERANCE);
+	CHECK(stats.max_jerk <= servo->nominal_jerk * LIMIT_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+
+	// Reversal stops on the end of the first leg
+	CHECK(servo_queue_move(servo, 250.0f, 250.0f, 0, NULL));
+	CHECK(servo_queue_move(servo, 200.0f, 250.0f, 0, NULL));
+	stats = run_queue(&axis, 1.0f, 0.0f);
+	CHECK_NEAR(servo_get_position(servo), 200.0f, SCALE_CUTTER / 4000.0f);
+	CHECK_NEAR(stats.max_pos, 250.0f / SCALE_CUTTER, POSITION_TOLERANCE);
+	CHECK(stats.stopped >= 1);
+	CHECK(stats.max_jerk <= servo->nominal_jerk * LIMIT_TOLERANCE);
+
+	// Dwell stops on the leg end for its time
+	CHECK(servo_queue_move(servo, 250.0f, 250.0f, 0, NULL));
+	CHECK(servo_queue_move(servo, 300.0f, 250.0f, 100, NULL));
+	stats = run_queue(&axis, 1.0f, 0.0f);
+	CHECK_NEAR(servo_get_position(servo), 300.0f, SCALE_CUTTER / 4000.0f);
+	CHECK(stats.stopped >= 100);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+
+	// Full queue refuses further legs, goto drops them
+	for (int i = 0; i < MOTION_QUEUE_SIZE; i++) {
+		CHECK(servo_queue_move(servo, 310.0f + i, 250.0f, 0, NULL));
+	}
+	CHECK(!servo_queue_move(servo, 400.0f, 250.0f, 0, NULL));
+	servo_goto(servo, 280.0f, 250.0f);
+	axis_run_settled(&axis, 20000);
+	CHECK_NEAR(servo_get_position(servo), 280.0f, SCALE_CUTTER / 4000.0f);
+
+	CHECK(!axis.error);
+	return test_result();
+}
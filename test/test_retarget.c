@@ -0,0 +1,120 @@
+// servo_retarget() of servo_motor.c: a moving axis is replanned from its
+// speed and acceleration to the new stop position and lands on it exactly.
+// Stops closer than the braking distance brake at full deceleration and return.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_CUTTER 20.0f
+#define JERK_CUTTER 40000.0f
+#define LIMIT_TOLERANCE 1.001f		// Float rounding of the limits
+#define POSITION_TOLERANCE 0.00001f	// Float rounding of positions in rev, 1/25 tic
+
+typedef struct {
+	float max_acc;		// Profile magnitudes in rev/s^2 and rev/s^3
+	float max_jerk;
+	float max_pos;		// Furthest positions in rev
+	float min_pos;
+	float backstep;		// Furthest step back in negative direction, in rev
+	float braking_end;	// Where full braking would have stopped at the retarget, in rev
+	uint32_t cycles;	// Cycles until the axis settled
+} retarget_stats_t;
+
+/**
+ * Starts a move to start_target and retargets it after the given cycles,
+ * runs until the axis settles. With repeat the retarget is called again
+ * every cycle.
+ */
+static retarget_stats_t run_retarget(test_axis_t* const axis, const float start_target,
+									const uint32_t after, const float target, const bool repeat) {
+	servo_t* const servo = axis->servo;
+	retarget_stats_t stats = {0.0f, 0.0f, servo->set_pos, servo->set_pos, 0.0f, 0.0f, 0};
+	float previous_pos = servo->set_pos;
+	float previous_acc = 0.0f;
+
+	servo_goto(servo, start_target, 250.0f);
+	for (uint32_t i = 0; i < 20000; i++) {
+		if (i == after) {
+			stats.braking_end = servo->set_pos + get_breaking_distance(servo);
+		}
+		if (i == after || (repeat && i > after)) {
+			servo_retarget(servo, target);
+		}
+		axis_cycle(axis);
+		stats.cycles++;
+		stats.max_acc = fmaxf(stats.max_acc, fabsf(servo->computed_acc));
+		stats.max_jerk = fmaxf(stats.max_jerk, fabsf(servo->computed_acc - previous_acc) / CYCLE_TIME);
+		stats.max_pos = fmaxf(stats.max_pos, servo->set_pos);
+		stats.min_pos = fminf(stats.min_pos, servo->set_pos);
+		stats.backstep = fmaxf(stats.backstep, previous_pos - servo->set_pos);
+		previous_pos = servo->set_pos;
+		previous_acc = servo->computed_acc;
+		if (i > after && servo_is_settled(servo)) {
+			break;
+		}
+	}
+	return stats;
+}
+
+/**
+ * Checks the axis stands on the target and kept the limits
+ */
+static void check_landed(const test_axis_t* const axis, const retarget_stats_t* const stats, const float target) {
+	const servo_t* const servo = axis->servo;
+	CHECK(servo_is_settled(servo));
+	CHECK_NEAR(servo_get_position(servo), target, SCALE_CUTTER / 4000.0f);
+	CHECK(stats->max_acc <= servo->nominal_acc * LIMIT_TOLERANCE);
+	CHECK(stats->max_jerk <= servo->nominal_jerk * LIMIT_TOLERANCE);
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Cutter", 0, SCALE_CUTTER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_CUTTER);
+
+	// Shorter at cruise, still reachable without overshoot
+	retarget_stats_t stats = run_retarget(&axis, 600.0f, 300, 200.0f, false);
+	check_landed(&axis, &stats, 200.0f);
+	CHECK(stats.max_pos <= 200.0f / SCALE_CUTTER + POSITION_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+
+	// Further while accelerating and while braking
+	stats = run_retarget(&axis, 300.0f, 50, 400.0f, false);
+	check_landed(&axis, &stats, 400.0f);
+	CHECK(stats.max_pos <= 400.0f / SCALE_CUTTER + POSITION_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+	stats = run_retarget(&axis, 500.0f, 480, 550.0f, false);
+	check_landed(&axis, &stats, 550.0f);
+	CHECK(stats.max_pos <= 550.0f / SCALE_CUTTER + POSITION_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+
+	// Closer than the braking distance, brakes at full deceleration and returns
+	stats = run_retarget(&axis, 1000.0f, 300, 600.0f, false);
+	check_landed(&axis, &stats, 600.0f);
+	CHECK(stats.max_pos > 600.0f / SCALE_CUTTER);
+	CHECK_NEAR(stats.max_pos, stats.braking_end, POSITION_TOLERANCE * 10.0f);
+	CHECK(stats.max_acc >= servo->nominal_acc / LIMIT_TOLERANCE);
+
+	// Same position again every cycle keeps the plan
+	const retarget_stats_t once = run_retarget(&axis, 900.0f, 100, 800.0f, false);
+	check_landed(&axis, &once, 800.0f);
+	servo_goto(servo, 600.0f, 250.0f);
+	axis_run_settled(&axis, 20000);
+	stats = run_retarget(&axis, 900.0f, 100, 800.0f, true);
+	check_landed(&axis, &stats, 800.0f);
+	CHECK(stats.cycles == once.cycles);
+	CHECK_NEAR(stats.max_pos, once.max_pos, POSITION_TOLERANCE);
+
+	// Standing axis simply moves, closer than a tic it stays
+	servo_retarget(servo, 810.0f);
+	CHECK(servo->positioning == REQUESTED);
+	axis_run_settled(&axis, 20000);
+	CHECK_NEAR(servo_get_position(servo), 810.0f, SCALE_CUTTER / 4000.0f);
+	servo_retarget(servo, 810.001f);
+	CHECK(servo->positioning == IDLE);
+
+	CHECK(!axis.error);
+	return test_result();
+}
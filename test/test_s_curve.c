@@ -0,0 +1,103 @@
+// Jerk-limited profile of servo_motor.c: the axis lands on the stop position
+// without overshoot, speed, acceleration and jerk stay within their limits
+// and the movement takes the time profile_time() predicts.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_CUTTER 20.0f
+#define JERK_CUTTER 40000.0f
+#define LIMIT_TOLERANCE 1.001f		// Float rounding of the limits
+#define POSITION_TOLERANCE 0.00001f	// Float rounding of positions in rev, 1/25 tic
+
+typedef struct {
+	float max_speed;	// Profile magnitudes in rev/s, rev/s^2 and rev/s^3
+	float max_acc;
+	float max_jerk;
+	float overshoot;	// Furthest travel past the stop position in rev
+	float backstep;		// Furthest step against the direction of movement in rev
+	uint32_t cycles;	// Cycles with the profile active
+} move_stats_t;
+
+/**
+ * Moves the axis and records the profile until it settles
+ */
+static move_stats_t run_move(test_axis_t* const axis, const float position, const float speed) {
+	servo_t* const servo = axis->servo;
+	move_stats_t stats = {0};
+	const float stop = position / servo->scale;
+	const float direction = stop >= servo->set_pos ? 1.0f : -1.0f;
+	float previous_pos = servo->set_pos;
+	float previous_acc = 0.0f;
+
+	servo_goto(servo, position, speed);
+	for (uint32_t i = 0; i < 20000 && !servo_is_settled(servo); i++) {
+		axis_cycle(axis);
+		stats.max_speed = fmaxf(stats.max_speed, fabsf(servo->computed_speed));
+		stats.max_acc = fmaxf(stats.max_acc, fabsf(servo->computed_acc));
+		stats.max_jerk = fmaxf(stats.max_jerk, fabsf(servo->computed_acc - previous_acc) / CYCLE_TIME);
+		stats.overshoot = fmaxf(stats.overshoot, (servo->set_pos - stop) * direction);
+		stats.backstep = fmaxf(stats.backstep, (previous_pos - servo->set_pos) * direction);
+		if (servo->positioning != IDLE) {
+			stats.cycles++;
+		}
+		previous_pos = servo->set_pos;
+		previous_acc = servo->computed_acc;
+	}
+	return stats;
+}
+
+/**
+ * Checks a movement from standstill to standstill against the limits
+ */
+static void check_move(test_axis_t* const axis, const float position, const float speed, const bool cruise) {
+	servo_t* const servo = axis->servo;
+	const float distance = fabsf(position / servo->scale - servo->set_pos);
+	const move_stats_t stats = run_move(axis, position, speed);
+	const float nominal_speed = speed / servo->scale;
+
+	CHECK(servo_is_settled(servo));
+	CHECK_NEAR(servo_get_position(servo), position, servo->scale / 4000.0f);
+	CHECK(stats.max_speed <= nominal_speed * LIMIT_TOLERANCE);
+	CHECK(stats.max_acc <= servo->nominal_acc * LIMIT_TOLERANCE);
+	CHECK(stats.max_jerk <= servo->nominal_jerk * LIMIT_TOLERANCE);
+	CHECK(stats.overshoot <= POSITION_TOLERANCE);
+	CHECK(stats.backstep <= POSITION_TOLERANCE);
+	if (cruise) {
+		CHECK(stats.max_speed >= nominal_speed / LIMIT_TOLERANCE);
+		CHECK(stats.max_acc >= servo->nominal_acc / LIMIT_TOLERANCE);
+	} else {
+		CHECK(stats.max_speed < nominal_speed);
+	}
+
+	// Discrete profile may take a few cycles longer than the continuous one
+	const float time = profile_time(distance, nominal_speed, servo->nominal_acc, servo->nominal_jerk, servo->profile);
+	CHECK_NEAR(stats.cycles * CYCLE_TIME, time, 0.01f * time + 5.0f * CYCLE_TIME);
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Cutter", 0, SCALE_CUTTER);
+	servo_set_profile(axis.servo, PROFILE_S_CURVE, JERK_CUTTER);
+
+	// Long stroke with cruise, full acceleration is reached
+	check_move(&axis, 600.0f, 250.0f, true);
+
+	// Back in negative direction with lower speed
+	check_move(&axis, -300.0f, 100.0f, true);
+
+	// Short movements never reach the speed, the shortest not even the acceleration
+	check_move(&axis, -295.0f, 250.0f, false);
+	check_move(&axis, -294.9f, 250.0f, false);
+
+	// Trapezoidal profile still lands on the stop position
+	servo_set_profile(axis.servo, PROFILE_TRAPEZOIDAL, 0.0f);
+	const move_stats_t stats = run_move(&axis, 0.0f, 250.0f);
+	CHECK(servo_is_settled(axis.servo));
+	CHECK_NEAR(servo_get_position(axis.servo), 0.0f, SCALE_CUTTER / 4000.0f);
+	CHECK(stats.max_speed <= 250.0f / SCALE_CUTTER * LIMIT_TOLERANCE);
+
+	CHECK(!axis.error);
+	return test_result();
+}
@@ -0,0 +1,72 @@
+// Settle detection of servo_motor.c: the axis is settled only when the
+// encoder stays in the window around the stop position, a movement which
+// does not settle raises an error after SETTLE_TIMEOUT cycles.
+
+#include "../servo_motor/servo_motor.c"
+#include "test.h"
+#include "test_axis.h"
+
+#define SCALE_CUTTER 20.0f
+#define JERK_CUTTER 40000.0f
+
+/**
+ * Moves the axis, the motor stays off the command by the disturbance once
+ * the profile finished. With a half period the disturbance flips its sign,
+ * the axis hunts around the stop position. Returns cycles from the end of
+ * the profile until the axis settled, or the given limit.
+ */
+static uint32_t run_disturbed(test_axis_t* const axis, const float position, const int64_t disturbance,
+							const uint32_t half_period, const uint32_t limit) {
+	servo_t* const servo = axis->servo;
+	axis->disturbance = 0;
+	servo_goto(servo, position, 250.0f);
+	while (!servo_is_idle(servo)) {
+		CHECK(!servo_is_settled(servo));
+		axis_cycle(axis);
+	}
+
+	uint32_t cycles = 0;
+	while (cycles < limit && !servo_is_settled(servo)) {
+		const bool flipped = half_period > 0 && (cycles / half_period) % 2 == 1;
+		axis->disturbance = flipped ? -disturbance : disturbance;
+		axis_cycle(axis);
+		cycles++;
+	}
+	return cycles;
+}
+
+int main(void) {
+	test_axis_t axis;
+	axis_init(&axis, "Cutter", 0, SCALE_CUTTER);
+	servo_t* const servo = axis.servo;
+	servo_set_profile(servo, PROFILE_S_CURVE, JERK_CUTTER);
+
+	// Axis settles once the observed speed has decayed and the required
+	// cycles passed in the window, 10 tics by default
+	CHECK(run_disturbed(&axis, 100.0f, 0, 0, 1000) <= 50);
+	CHECK(run_disturbed(&axis, 50.0f, 8, 0, 1000) <= 50);
+	CHECK(!axis.error);
+
+	// Window given in mm, 0.1mm is 20 tics of the cutter
+	servo_set_settle_window(servo, 0.1f, 2.0f, SETTLE_TICKS);
+	CHECK(run_disturbed(&axis, 100.0f, 15, 0, 1000) <= 50);
+	CHECK(!axis.error);
+
+	// Hunting outside the window never settles and the timeout stops the machine
+	const uint32_t cycles = run_disturbed(&axis, 50.0f, 25, 10, SETTLE_TIMEOUT + 10);
+	CHECK(!servo_is_settled(servo));
+	CHECK(cycles == SETTLE_TIMEOUT + 10);
+	CHECK(axis.error);
+	CHECK(strcmp(axis.message, "Cutter: Not Settled") == 0);
+
+	// No error before the timeout
+	axis.error = false;
+	axis.enable = false;
+	axis_cycle(&axis);
+	axis.enable = true;
+	const uint32_t short_wait = run_disturbed(&axis, 100.0f, 25, 10, SETTLE_TIMEOUT - 10);
+	CHECK(short_wait == SETTLE_TIMEOUT - 10);
+	CHECK(!axis.error);
+
+	return test_result();
+}
@@ -0,0 +1,80 @@
+// state_observer.c: the estimate follows constant velocity and constant
+// acceleration without error, settles within a few time constants of the
+// bandwidth, and a known input is taken as acceleration at once.
+
+#include "state_observer.h"
+#include "test.h"
+
+#define PERIOD 0.001f
+#define BANDWIDTH 400.0f
+#define TIC 0.00025f		// Encoder tic in rev
+
+/**
+ * Feeds the movement of the given acceleration for the given updates,
+ * the axis moves at speed at the start. Returns the speed at the end.
+ */
+static float run(state_observer_t* const observer, float speed, const float acc, const float input, const int updates) {
+	for (int i = 0; i < updates; i++) {
+		observer_update(observer, speed * PERIOD + acc * PERIOD * PERIOD / 2.0f, input);
+		speed += acc * PERIOD;
+	}
+	return speed;
+}
+
+int main(void) {
+	state_observer_t* const observer = observer_create(PERIOD, BANDWIDTH);
+	const int settle = (int)(10.0f / BANDWIDTH / PERIOD);
+
+	// At rest
+	run(observer, 0.0f, 0.0f, 0.0f, 10);
+	CHECK(observer_get_velocity(observer) == 0.0f);
+	CHECK(observer_get_offset(observer) == 0.0f);
+
+	// Step of velocity settles within ten time constants, without error at constant velocity
+	run(observer, 10.0f, 0.0f, 0.0f, settle);
+	CHECK_NEAR(observer_get_velocity(observer), 10.0f, 0.1f);
+	run(observer, 10.0f, 0.0f, 0.0f, 200);
+	CHECK_NEAR(observer_get_velocity(observer), 10.0f, 1e-4f);
+	CHECK_NEAR(observer_get_acceleration(observer), 0.0f, 1e-2f);
+	CHECK_NEAR(observer_get_offset(observer), 0.0f, 1e-6f);
+
+	// Constant acceleration is followed without error too
+	const float speed = run(observer, 10.0f, 100.0f, 0.0f, 300);
+	CHECK_NEAR(observer_get_acceleration(observer), 100.0f, 0.1f);
+	CHECK_NEAR(observer_get_velocity(observer), speed, 1e-3f);
+	CHECK_NEAR(observer_get_offset(observer), 0.0f, 1e-6f);
+
+	// Known input is acceleration at once, the disturbance stays at zero
+	observer_reset(observer);
+	observer_set_input_gain(observer, 2.0f);
+	run(observer, 0.0f, 100.0f, 50.0f, 1);
+	CHECK_NEAR(observer_get_acceleration(observer), 100.0f, 0.01f);
+	CHECK_NEAR(observer_get_velocity(observer), 0.1f, 1e-4f);
+	run(observer, 0.1f, 100.0f, 50.0f, 100);
+	CHECK_NEAR(observer_get_acceleration(observer), 100.0f, 0.01f);
+	CHECK_NEAR(observer_get_acceleration(observer) - 2.0f * 50.0f, 0.0f, 0.01f);
+
+	// Friction the input does not explain is estimated as disturbance
+	observer_reset(observer);
+	run(observer, 0.0f, 80.0f, 50.0f, settle + 200);
+	CHECK_NEAR(observer_get_acceleration(observer), 80.0f, 0.1f);
+
+	// Slow axis, one tic every five updates. The velocity is right on average and
+	// stays well inside the differences of the counts, which jump from 0 to 5 times it
+	observer_reset(observer);
+	observer_set_input_gain(observer, 0.0f);
+	float sum = 0.0f, max_velocity = 0.0f, min_velocity = 1.0f;
+	for (int i = 0; i < 1000 + settle; i++) {
+		observer_update(observer, i % 5 == 0 ? TIC : 0.0f, 0.0f);
+		if (i >= settle) {
+			sum += observer_get_velocity(observer);
+			max_velocity = fmaxf(max_velocity, observer_get_velocity(observer));
+			min_velocity = fminf(min_velocity, observer_get_velocity(observer));
+		}
+	}
+	CHECK_NEAR(sum / 1000.0f, TIC / (5.0f * PERIOD), 1e-3f);
+	CHECK(min_velocity > 0.0f);
+	CHECK(max_velocity < 2.0f * TIC / (5.0f * PERIOD));
+
+	return test_result();
+}